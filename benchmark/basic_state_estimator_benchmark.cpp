@@ -0,0 +1,513 @@
+/*!*******************************************************************************************
+ *  \file       basic_state_estimator_benchmark.cpp
+ *  \brief      Microbenchmarks of the basic state estimator hot path
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "basic_state_estimator.hpp"
+
+// Heap allocations of the threads that set allocation_counting, see BM_SteadyStateAllocations
+thread_local bool allocation_counting = false;
+std::atomic<std::size_t> allocation_count{0};
+
+void *operator new(std::size_t _size)
+{
+  if (allocation_counting)
+  {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (void *ptr = std::malloc(_size == 0 ? 1 : _size))
+  {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new(std::size_t _size, std::align_val_t _alignment)
+{
+  if (allocation_counting)
+  {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+  }
+  const std::size_t alignment = static_cast<std::size_t>(_alignment);
+  // aligned_alloc needs a size multiple of the alignment
+  if (void *ptr = std::aligned_alloc(alignment, (_size + alignment - 1) / alignment * alignment))
+  {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *_ptr) noexcept { std::free(_ptr); }
+void operator delete(void *_ptr, std::size_t) noexcept { std::free(_ptr); }
+void operator delete(void *_ptr, std::align_val_t) noexcept { std::free(_ptr); }
+void operator delete(void *_ptr, std::size_t, std::align_val_t) noexcept { std::free(_ptr); }
+
+// Estimation mode of each benchmark argument
+const std::vector<std::string> mode_parameters = {"odom_only", "ground_truth", "sensor_fusion"};
+
+/**
+ * @brief Access to the pipeline stages of BasicStateEstimator
+ */
+class BasicStateEstimatorBenchmark
+{
+public:
+  static std::shared_ptr<BasicStateEstimator> createEstimator(const std::size_t _mode,
+                                                              const bool _publish_on_input = false,
+                                                              const bool _intra_process = true)
+  {
+    rclcpp::NodeOptions options;
+    options.arguments({"--ros-args", "-r", "__ns:=/bench" + std::to_string(_mode)});
+    options.use_intra_process_comms(_intra_process);
+    options.parameter_overrides({rclcpp::Parameter(mode_parameters[_mode], true),
+                                 rclcpp::Parameter("publish_on_input", _publish_on_input),
+                                 rclcpp::Parameter("max_publish_rate", 0.0),
+                                 rclcpp::Parameter("diagnostics_period", 0.0)});
+    auto estimator = std::make_shared<BasicStateEstimator>(options);
+    estimator->configure();
+    estimator->activate();
+    feedInputs(*estimator, 0);
+    return estimator;
+  }
+
+  struct Inputs
+  {
+    nav_msgs::msg::Odometry::SharedPtr odom;
+    geometry_msgs::msg::PoseStamped::SharedPtr gt_pose;
+    geometry_msgs::msg::TwistStamped::SharedPtr gt_twist;
+  };
+
+  static Inputs makeInputs(const int32_t _seq)
+  {
+    auto odom = std::make_shared<nav_msgs::msg::Odometry>();
+    odom->header.stamp.sec = _seq / 100;
+    odom->header.stamp.nanosec = (_seq % 100) * 10000000u;
+    odom->pose.pose.position.x = 0.01 * _seq;
+    odom->pose.pose.position.z = 1.0;
+    odom->pose.pose.orientation.z = 0.3826834;
+    odom->pose.pose.orientation.w = 0.9238795;
+    odom->twist.twist.linear.x = 1.0;
+    odom->twist.twist.angular.z = 0.1;
+
+    auto gt_pose = std::make_shared<geometry_msgs::msg::PoseStamped>();
+    gt_pose->header.stamp = odom->header.stamp;
+    gt_pose->pose = odom->pose.pose;
+
+    auto gt_twist = std::make_shared<geometry_msgs::msg::TwistStamped>();
+    gt_twist->header.stamp = odom->header.stamp;
+    gt_twist->header.frame_id = "bench/base_link";
+    gt_twist->twist = odom->twist.twist;
+    return {odom, gt_pose, gt_twist};
+  }
+
+  static void feedInputs(BasicStateEstimator &_estimator, const Inputs &_inputs)
+  {
+    _estimator.odomCallback(_inputs.odom);
+    _estimator.gtPoseCallback(_inputs.gt_pose);
+    _estimator.gtTwistCallback(_inputs.gt_twist);
+  }
+
+  static void feedInputs(BasicStateEstimator &_estimator, const int32_t _seq)
+  {
+    feedInputs(_estimator, makeInputs(_seq));
+  }
+
+  // Stands for the period between cycles, in which the refill thread replaces the spares taken
+  // by the intra-process publishers
+  static void waitForReserves(BasicStateEstimator &_estimator)
+  {
+    while (!_estimator.pose_reserve_.full() || !_estimator.twist_reserve_.full())
+    {
+      std::this_thread::yield();
+    }
+  }
+
+  static void consumeInputs(BasicStateEstimator &_estimator) { _estimator.consumeInputs(); }
+
+  static void getGlobalRefState(BasicStateEstimator &_estimator)
+  {
+    _estimator.getGlobalRefState();
+  }
+
+  static void generatePoseStampedMsg(BasicStateEstimator &_estimator,
+                                     geometry_msgs::msg::PoseStamped &_msg)
+  {
+    _estimator.generatePoseStampedMsg(_estimator.estimation_stamp_, _msg);
+  }
+
+  static void generateTwistStampedMsg(BasicStateEstimator &_estimator,
+                                      geometry_msgs::msg::TwistStamped &_msg)
+  {
+    _estimator.generateTwistStampedMsg(_estimator.estimation_stamp_, _msg);
+  }
+
+  static const basic_state_estimator::Pose &odom2baselink(BasicStateEstimator &_estimator)
+  {
+    return _estimator.odom2baselink_;
+  }
+};
+
+static void BM_UpdateOdomTfDrift(benchmark::State &_state)
+{
+  auto estimator = BasicStateEstimatorBenchmark::createEstimator(_state.range(0));
+  BasicStateEstimatorBenchmark::consumeInputs(*estimator);
+  const basic_state_estimator::Pose map2baselink = estimator->calculateLocalization();
+  const basic_state_estimator::Pose odom2baselink =
+      BasicStateEstimatorBenchmark::odom2baselink(*estimator);
+  for (auto _ : _state)
+  {
+    estimator->updateOdomTfDrift(odom2baselink, map2baselink);
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_UpdateOdomTfDrift)->DenseRange(0, 2);
+
+static void BM_CalculateLocalization(benchmark::State &_state)
+{
+  auto estimator = BasicStateEstimatorBenchmark::createEstimator(_state.range(0));
+  BasicStateEstimatorBenchmark::consumeInputs(*estimator);
+  for (auto _ : _state)
+  {
+    benchmark::DoNotOptimize(estimator->calculateLocalization());
+  }
+}
+BENCHMARK(BM_CalculateLocalization)->DenseRange(0, 2);
+
+static void BM_GetGlobalRefState(benchmark::State &_state)
+{
+  auto estimator = BasicStateEstimatorBenchmark::createEstimator(_state.range(0));
+  BasicStateEstimatorBenchmark::consumeInputs(*estimator);
+  estimator->calculateLocalization();
+  for (auto _ : _state)
+  {
+    BasicStateEstimatorBenchmark::getGlobalRefState(*estimator);
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_GetGlobalRefState)->DenseRange(0, 2);
+
+static void BM_ConvertFLUtoENU(benchmark::State &_state)
+{
+  const tf2::Quaternion orientation(0.0, 0.0, 0.3826834, 0.9238795);
+  const Eigen::Vector3d flu_twist(1.0, 0.5, 0.1);
+  for (auto _ : _state)
+  {
+    benchmark::DoNotOptimize(as2::FrameUtils::convertFLUtoENU(orientation, flu_twist));
+  }
+}
+BENCHMARK(BM_ConvertFLUtoENU);
+
+/**
+ * @brief Drift, global pose and global twist of one odom only cycle as they were computed on
+ * messages, with tf2 and as2::FrameUtils round trips, to compare with BM_FrameConversion
+ */
+static void BM_FrameConversionMessages(benchmark::State &_state)
+{
+  geometry_msgs::msg::Transform odom2baselink;
+  odom2baselink.translation.x = 1.0;
+  odom2baselink.rotation.z = 0.3826834;
+  odom2baselink.rotation.w = 0.9238795;
+  const geometry_msgs::msg::Transform map2baselink = odom2baselink;
+  geometry_msgs::msg::Twist odom_twist;
+  odom_twist.linear.x = 1.0;
+  const tf2::Transform global2map = tf2::Transform::getIdentity();
+  geometry_msgs::msg::Transform map2odom;
+  geometry_msgs::msg::Pose global_pose;
+  geometry_msgs::msg::Twist global_twist;
+  for (auto _ : _state)
+  {
+    const tf2::Quaternion drift_q =
+        tf2::Quaternion(map2baselink.rotation.x, map2baselink.rotation.y,
+                        map2baselink.rotation.z, map2baselink.rotation.w) *
+        tf2::inverse(tf2::Quaternion(odom2baselink.rotation.x, odom2baselink.rotation.y,
+                                     odom2baselink.rotation.z, odom2baselink.rotation.w));
+    map2odom.translation.x = map2baselink.translation.x - odom2baselink.translation.x;
+    map2odom.translation.y = map2baselink.translation.y - odom2baselink.translation.y;
+    map2odom.translation.z = map2baselink.translation.z - odom2baselink.translation.z;
+    map2odom.rotation.x = drift_q.x();
+    map2odom.rotation.y = drift_q.y();
+    map2odom.rotation.z = drift_q.z();
+    map2odom.rotation.w = drift_q.w();
+
+    const tf2::Transform map2odom_tf(
+        tf2::Quaternion(map2odom.rotation.x, map2odom.rotation.y, map2odom.rotation.z,
+                        map2odom.rotation.w),
+        tf2::Vector3(map2odom.translation.x, map2odom.translation.y, map2odom.translation.z));
+    const tf2::Transform odom2baselink_tf(
+        tf2::Quaternion(odom2baselink.rotation.x, odom2baselink.rotation.y,
+                        odom2baselink.rotation.z, odom2baselink.rotation.w),
+        tf2::Vector3(odom2baselink.translation.x, odom2baselink.translation.y,
+                     odom2baselink.translation.z));
+    const tf2::Transform global2baselink = global2map * map2odom_tf * odom2baselink_tf;
+    const tf2::Vector3 &position = global2baselink.getOrigin();
+    const tf2::Quaternion rotation = global2baselink.getRotation();
+    global_pose.position.x = position.x();
+    global_pose.position.y = position.y();
+    global_pose.position.z = position.z();
+    global_pose.orientation.x = rotation.x();
+    global_pose.orientation.y = rotation.y();
+    global_pose.orientation.z = rotation.z();
+    global_pose.orientation.w = rotation.w();
+
+    const tf2::Quaternion orientation(global_pose.orientation.x, global_pose.orientation.y,
+                                      global_pose.orientation.z, global_pose.orientation.w);
+    const Eigen::Vector3d global_velocity = as2::FrameUtils::convertFLUtoENU(
+        orientation, Eigen::Vector3d(odom_twist.linear.x, odom_twist.linear.y,
+                                     odom_twist.linear.z));
+    global_twist.linear.x = global_velocity.x();
+    global_twist.linear.y = global_velocity.y();
+    global_twist.linear.z = global_velocity.z();
+    benchmark::DoNotOptimize(global_twist);
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_FrameConversionMessages);
+
+/**
+ * @brief Same cycle on the internal representation, as the estimation computes it now
+ */
+static void BM_FrameConversion(benchmark::State &_state)
+{
+  basic_state_estimator::Pose odom2baselink;
+  odom2baselink.position.x() = 1.0;
+  odom2baselink.orientation = Eigen::Quaterniond(0.9238795, 0.0, 0.0, 0.3826834);
+  const basic_state_estimator::Pose map2baselink = odom2baselink;
+  const Eigen::Vector3d odom_velocity(1.0, 0.0, 0.0);
+  const basic_state_estimator::EstimatorCore core;
+  for (auto _ : _state)
+  {
+    const basic_state_estimator::Pose map2odom =
+        basic_state_estimator::driftBetween(odom2baselink, map2baselink);
+    const basic_state_estimator::Pose global_pose = core.globalPose(map2odom, odom2baselink);
+    const Eigen::Vector3d global_velocity = global_pose.orientation * odom_velocity;
+    benchmark::DoNotOptimize(global_velocity);
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_FrameConversion);
+
+static void BM_SwarmKernelUpdate(benchmark::State &_state)
+{
+  // Drift, global pose and global twist of the whole swarm in one pass
+  const std::size_t drones = static_cast<std::size_t>(_state.range(0));
+  basic_state_estimator::SwarmKernel kernel(drones);
+  kernel.odom2baselink.x.setRandom();
+  kernel.map2baselink.qz.setConstant(0.3826834);
+  kernel.map2baselink.qw.setConstant(0.9238795);
+  kernel.body_velocity.x.setConstant(1.0);
+  for (auto _ : _state)
+  {
+    kernel.update();
+    benchmark::DoNotOptimize(kernel.global_velocity.x.data());
+    benchmark::ClobberMemory();
+  }
+  _state.SetItemsProcessed(_state.iterations() * _state.range(0));
+}
+BENCHMARK(BM_SwarmKernelUpdate)->RangeMultiplier(4)->Range(1, 1024);
+
+static void BM_GeneratePoseStampedMsg(benchmark::State &_state)
+{
+  auto estimator = BasicStateEstimatorBenchmark::createEstimator(0);
+  geometry_msgs::msg::PoseStamped msg;
+  for (auto _ : _state)
+  {
+    BasicStateEstimatorBenchmark::generatePoseStampedMsg(*estimator, msg);
+    benchmark::DoNotOptimize(msg);
+  }
+}
+BENCHMARK(BM_GeneratePoseStampedMsg);
+
+static void BM_GenerateTwistStampedMsg(benchmark::State &_state)
+{
+  auto estimator = BasicStateEstimatorBenchmark::createEstimator(0);
+  geometry_msgs::msg::TwistStamped msg;
+  for (auto _ : _state)
+  {
+    BasicStateEstimatorBenchmark::generateTwistStampedMsg(*estimator, msg);
+    benchmark::DoNotOptimize(msg);
+  }
+}
+BENCHMARK(BM_GenerateTwistStampedMsg);
+
+static void BM_Run(benchmark::State &_state)
+{
+  auto estimator = BasicStateEstimatorBenchmark::createEstimator(_state.range(0));
+  int32_t seq = 1;
+  for (auto _ : _state)
+  {
+    BasicStateEstimatorBenchmark::feedInputs(*estimator, seq++);
+    estimator->run();
+  }
+}
+BENCHMARK(BM_Run)->DenseRange(0, 2);
+
+/**
+ * @brief Heap allocations of the estimation cycle once warmed up, from the input callbacks to the
+ * middleware publish, with intra-process comms and a probe node taking the pose and twist as
+ * unique_ptrs. The input messages are created outside the counted section, as the executor
+ * would, and the probe callbacks and the refill thread are not counted either. The second
+ * argument enables publish_on_input, which estimates in the callbacks instead of in run().
+ */
+static void BM_SteadyStateAllocations(benchmark::State &_state)
+{
+  const std::size_t mode = _state.range(0);
+  const bool publish_on_input = _state.range(1) != 0;
+  auto estimator = BasicStateEstimatorBenchmark::createEstimator(mode, publish_on_input);
+  const std::string ns = "/bench" + std::to_string(mode) + "/";
+  auto probe = std::make_shared<rclcpp::Node>(
+      "basic_state_estimator_probe", rclcpp::NodeOptions().use_intra_process_comms(true));
+
+  std::size_t received = 0;
+  auto pose_sub = probe->create_subscription<geometry_msgs::msg::PoseStamped>(
+      ns + as2_names::topics::self_localization::pose, as2_names::topics::self_localization::qos,
+      [&received](std::unique_ptr<geometry_msgs::msg::PoseStamped>) { received++; });
+  auto twist_sub = probe->create_subscription<geometry_msgs::msg::TwistStamped>(
+      ns + as2_names::topics::self_localization::twist, as2_names::topics::self_localization::qos,
+      [&received](std::unique_ptr<geometry_msgs::msg::TwistStamped>) { received++; });
+  rclcpp::executors::SingleThreadedExecutor executor;
+  executor.add_node(probe->get_node_base_interface());
+
+  int32_t seq = 1;
+  auto cycle = [&estimator, &executor, publish_on_input, &seq](const bool _counted) {
+    const BasicStateEstimatorBenchmark::Inputs inputs =
+        BasicStateEstimatorBenchmark::makeInputs(seq++);
+    allocation_counting = _counted;
+    BasicStateEstimatorBenchmark::feedInputs(*estimator, inputs);
+    if (!publish_on_input)
+    {
+      estimator->run();
+    }
+    allocation_counting = false;
+    executor.spin_some();
+    BasicStateEstimatorBenchmark::waitForReserves(*estimator);
+  };
+  while (seq < 100)
+  {
+    cycle(false);
+  }
+  allocation_count = 0;
+  received = 0;
+  for (auto _ : _state)
+  {
+    cycle(true);
+  }
+  const std::size_t allocations = allocation_count;
+  _state.counters["allocations"] = static_cast<double>(allocations);
+  _state.counters["received"] = static_cast<double>(received);
+  if (received == 0)
+  {
+    _state.SkipWithError("the probe received no intra-process message");
+  }
+  else if (allocations > 0)
+  {
+    _state.SkipWithError("estimation cycle allocated after warm-up");
+  }
+}
+BENCHMARK(BM_SteadyStateAllocations)->ArgsProduct({{0, 1, 2}, {0, 1}});
+
+/**
+ * @brief Odometry message published by a probe node until the estimated pose comes back, both
+ * nodes on the intra-process path of the same executor
+ */
+static void BM_CallbackToPublish(benchmark::State &_state)
+{
+  const std::size_t mode = _state.range(0);
+  auto estimator = BasicStateEstimatorBenchmark::createEstimator(mode, true);
+  const std::string ns = "/bench" + std::to_string(mode) + "/";
+  auto probe = std::make_shared<rclcpp::Node>(
+      "basic_state_estimator_probe", rclcpp::NodeOptions().use_intra_process_comms(true));
+
+  std::atomic<bool> received{false};
+  auto pose_sub = probe->create_subscription<geometry_msgs::msg::PoseStamped>(
+      ns + as2_names::topics::self_localization::pose, as2_names::topics::self_localization::qos,
+      [&received](const geometry_msgs::msg::PoseStamped::SharedPtr) { received = true; });
+  auto odom_pub = probe->create_publisher<nav_msgs::msg::Odometry>(
+      ns + as2_names::topics::sensor_measurements::odom,
+      as2_names::topics::sensor_measurements::qos);
+  auto gt_pose_pub = probe->create_publisher<geometry_msgs::msg::PoseStamped>(
+      ns + as2_names::topics::ground_truth::pose, as2_names::topics::sensor_measurements::qos);
+
+  rclcpp::executors::SingleThreadedExecutor executor;
+  executor.add_node(estimator->get_node_base_interface());
+  executor.add_node(probe->get_node_base_interface());
+
+  int32_t seq = 1;
+  for (auto _ : _state)
+  {
+    received = false;
+    auto odom = std::make_unique<nav_msgs::msg::Odometry>();
+    odom->header.stamp = probe->now();
+    odom->pose.pose.position.x = 0.01 * seq++;
+    if (mode == 1)
+    {
+      auto gt_pose = std::make_unique<geometry_msgs::msg::PoseStamped>();
+      gt_pose->header = odom->header;
+      gt_pose->pose = odom->pose.pose;
+      gt_pose_pub->publish(std::move(gt_pose));
+    }
+    else
+    {
+      odom_pub->publish(std::move(odom));
+    }
+    while (!received && rclcpp::ok())
+    {
+      executor.spin_some();
+    }
+  }
+}
+BENCHMARK(BM_CallbackToPublish)->DenseRange(0, 2)->UseRealTime();
+
+int main(int argc, char **argv)
+{
+  rclcpp::init(argc, argv);
+#if defined(__aarch64__)
+  benchmark::AddCustomContext("arch", "aarch64");
+#elif defined(__x86_64__)
+  benchmark::AddCustomContext("arch", "x86_64");
+#endif
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  rclcpp::shutdown();
+  return 0;
+}
@@ -0,0 +1,275 @@
+/*!*******************************************************************************************
+ *  \file       scaling_driver.cpp
+ *  \brief      Synthetic odometry driver measuring how the estimators scale with drones
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <geometry_msgs/msg/pose_stamped.hpp>
+#include <nav_msgs/msg/odometry.hpp>
+#include <rclcpp/rclcpp.hpp>
+
+#include "as2_core/names/topics.hpp"
+#include "latency_statistics.hpp"
+
+namespace
+{
+
+struct ProcessUsage
+{
+  double cpu_time = 0.0; // [s] user + system
+  double rss = 0.0;      // [MiB]
+};
+
+// Usage of every process whose executable name is _process_name, excluding this one
+ProcessUsage readProcessUsage(const std::string &_process_name)
+{
+  ProcessUsage usage;
+  DIR *proc = opendir("/proc");
+  if (proc == nullptr)
+  {
+    return usage;
+  }
+  const std::string self = std::to_string(getpid());
+  const double ticks = static_cast<double>(sysconf(_SC_CLK_TCK));
+  const double page_size = static_cast<double>(sysconf(_SC_PAGESIZE));
+  while (const dirent *entry = readdir(proc))
+  {
+    const std::string pid = entry->d_name;
+    if (pid.empty() || !std::all_of(pid.begin(), pid.end(), ::isdigit) || pid == self)
+    {
+      continue;
+    }
+    std::ifstream cmdline("/proc/" + pid + "/cmdline");
+    std::string executable;
+    std::getline(cmdline, executable, '\0');
+    if (executable.substr(executable.find_last_of('/') + 1) != _process_name)
+    {
+      continue;
+    }
+    // The command name may hold spaces, the fields are counted after its closing parenthesis
+    std::ifstream stat_file("/proc/" + pid + "/stat");
+    const std::string stat((std::istreambuf_iterator<char>(stat_file)),
+                           std::istreambuf_iterator<char>());
+    std::istringstream fields(stat.substr(stat.rfind(')') + 2));
+    std::string field;
+    double utime = 0.0, stime = 0.0, rss_pages = 0.0;
+    for (int i = 3; fields >> field; i++)
+    {
+      if (i == 14)
+      {
+        utime = std::stod(field);
+      }
+      else if (i == 15)
+      {
+        stime = std::stod(field);
+      }
+      else if (i == 24)
+      {
+        rss_pages = std::stod(field);
+        break;
+      }
+    }
+    usage.cpu_time += (utime + stime) / ticks;
+    usage.rss += rss_pages * page_size / (1024.0 * 1024.0);
+  }
+  closedir(proc);
+  return usage;
+}
+
+} // namespace
+
+/**
+ * @brief Publishes synthetic odometry to every drone at odom_rate and measures, over duration
+ * seconds after a warmup, the odometry -> self_localization/pose latency and the CPU and memory
+ * of the estimator processes. Appends one JSON line to output and exits.
+ */
+class ScalingDriver : public rclcpp::Node
+{
+public:
+  ScalingDriver() : rclcpp::Node("basic_state_estimator_scaling_driver")
+  {
+    deployment_ = this->declare_parameter<std::string>("deployment", "processes");
+    process_name_ =
+        this->declare_parameter<std::string>("process_name", "basic_state_estimator_node");
+    const int64_t drones = this->declare_parameter<int64_t>("drones", 1);
+    odom_rate_ = this->declare_parameter<double>("odom_rate", 100.0);
+    warmup_ = this->declare_parameter<double>("warmup", 2.0);
+    duration_ = this->declare_parameter<double>("duration", 10.0);
+    output_ = this->declare_parameter<std::string>("output", "scaling_results.jsonl");
+
+    drones_.resize(static_cast<std::size_t>(std::max<int64_t>(drones, 1)));
+    // Storage for every expected sample, so the measurement never allocates
+    latencies_ = basic_state_estimator::LatencyStatistics(
+        static_cast<std::size_t>(odom_rate_ * duration_ * drones_.size()) + 1);
+    odom_msg_.pose.pose.orientation.w = 1.0;
+    odom_msg_.twist.twist.linear.x = 1.0;
+    for (std::size_t i = 0; i < drones_.size(); i++)
+    {
+      const std::string ns = "/drone" + std::to_string(i);
+      Drone &drone = drones_[i];
+      drone.odom_pub = this->create_publisher<nav_msgs::msg::Odometry>(
+          ns + "/sensor_measurements/odom", as2_names::topics::sensor_measurements::qos);
+      drone.pose_sub = this->create_subscription<geometry_msgs::msg::PoseStamped>(
+          ns + "/self_localization/pose", as2_names::topics::self_localization::qos,
+          [this, i](const geometry_msgs::msg::PoseStamped::SharedPtr _msg)
+          { poseCallback(*_msg, i); });
+    }
+    start_ = this->get_clock()->now();
+    odom_timer_ = this->create_wall_timer(std::chrono::duration<double>(1.0 / odom_rate_),
+                                          std::bind(&ScalingDriver::publishOdometry, this));
+    RCLCPP_INFO(get_logger(), "DRIVING %zu DRONES (%s) AT %.1f Hz", drones_.size(),
+                deployment_.c_str(), odom_rate_);
+  }
+
+private:
+  struct Drone
+  {
+    rclcpp::Publisher<nav_msgs::msg::Odometry>::SharedPtr odom_pub;
+    rclcpp::Subscription<geometry_msgs::msg::PoseStamped>::SharedPtr pose_sub;
+    int64_t last_stamp = 0;
+  };
+
+  std::string deployment_;
+  std::string process_name_;
+  double odom_rate_;
+  double warmup_;
+  double duration_;
+  std::string output_;
+
+  std::vector<Drone> drones_;
+  nav_msgs::msg::Odometry odom_msg_;
+  rclcpp::TimerBase::SharedPtr odom_timer_;
+  rclcpp::Time start_;
+  uint64_t sequence_ = 0;
+
+  bool measuring_ = false;
+  rclcpp::Time measure_start_;
+  ProcessUsage usage_start_;
+  uint64_t sent_ = 0;
+  uint64_t received_ = 0;
+  basic_state_estimator::LatencyStatistics latencies_;
+
+  void publishOdometry()
+  {
+    const rclcpp::Time now = this->get_clock()->now();
+    const double elapsed = (now - start_).seconds();
+    if (!measuring_ && elapsed >= warmup_)
+    {
+      measuring_ = true;
+      measure_start_ = now;
+      usage_start_ = readProcessUsage(process_name_);
+    }
+    if (measuring_ && elapsed >= warmup_ + duration_)
+    {
+      writeResults(now);
+      rclcpp::shutdown();
+      return;
+    }
+    odom_msg_.pose.pose.position.x = 0.01 * static_cast<double>(sequence_++);
+    for (Drone &drone : drones_)
+    {
+      // Stamped at publication, the estimate keeps the stamp of its measurement
+      odom_msg_.header.stamp = this->get_clock()->now();
+      drone.odom_pub->publish(odom_msg_);
+    }
+    if (measuring_)
+    {
+      sent_ += drones_.size();
+    }
+  }
+
+  void poseCallback(const geometry_msgs::msg::PoseStamped &_msg, const std::size_t _drone)
+  {
+    const int64_t stamp = rclcpp::Time(_msg.header.stamp).nanoseconds();
+    Drone &drone = drones_[_drone];
+    // Cycles without new odometry republish the last estimate
+    if (stamp == drone.last_stamp)
+    {
+      return;
+    }
+    drone.last_stamp = stamp;
+    if (!measuring_ || stamp < measure_start_.nanoseconds())
+    {
+      return;
+    }
+    received_++;
+    latencies_.addSample((this->get_clock()->now().nanoseconds() - stamp) * 1e-9);
+  }
+
+  void writeResults(const rclcpp::Time &_now)
+  {
+    const double wall = (_now - measure_start_).seconds();
+    const ProcessUsage usage_end = readProcessUsage(process_name_);
+    const double drones = static_cast<double>(drones_.size());
+    const double cpu = 100.0 * (usage_end.cpu_time - usage_start_.cpu_time) / wall;
+    double p50 = 0.0, p99 = 0.0, max = 0.0;
+    latencies_.getPercentiles(p50, p99, max);
+
+    char line[1024];
+    std::snprintf(line, sizeof(line),
+                  "{\"deployment\": \"%s\", \"drones\": %zu, \"odom_rate\": %.1f, "
+                  "\"duration\": %.3f, \"sent\": %lu, \"received\": %lu, "
+                  "\"latency_p50_ms\": %.3f, \"latency_p99_ms\": %.3f, \"latency_max_ms\": %.3f, "
+                  "\"cpu_percent\": %.2f, \"cpu_percent_per_drone\": %.3f, "
+                  "\"rss_mib\": %.1f, \"rss_mib_per_drone\": %.2f}",
+                  deployment_.c_str(), drones_.size(), odom_rate_, wall,
+                  static_cast<unsigned long>(sent_), static_cast<unsigned long>(received_),
+                  p50 * 1e3, p99 * 1e3, max * 1e3, cpu, cpu / drones, usage_end.rss,
+                  usage_end.rss / drones);
+    std::ofstream(output_, std::ios::app) << line << std::endl;
+    RCLCPP_INFO(get_logger(), "%s", line);
+  }
+};
+
+int main(int argc, char *argv[])
+{
+  rclcpp::init(argc, argv);
+  auto driver = std::make_shared<ScalingDriver>();
+  rclcpp::spin(driver);
+  rclcpp::shutdown();
+  return 0;
+}
@@ -37,83 +37,508 @@
 #ifndef BASIC_STATE_ESTIMATOR_HPP_
 #define BASIC_STATE_ESTIMATOR_HPP_
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <thread>
+
+#include <tf2/LinearMath/Transform.h>
 #include <tf2/exceptions.h>
+#include <tf2_msgs/msg/tf_message.hpp>
 #include <tf2_ros/buffer.h>
+#include <tf2_ros/qos.hpp>
 #include <tf2_ros/static_transform_broadcaster.h>
-#include <tf2_ros/transform_broadcaster.h>
 #include <tf2_ros/transform_listener.h>
 
+#include <diagnostic_msgs/msg/diagnostic_array.hpp>
 #include <geometry_msgs/msg/pose_stamped.hpp>
+#include <geometry_msgs/msg/pose_with_covariance_stamped.hpp>
 #include <geometry_msgs/msg/twist_stamped.hpp>
+#include <geometry_msgs/msg/twist_with_covariance_stamped.hpp>
 #include <rclcpp/rclcpp.hpp>
+#include <sensor_msgs/msg/imu.hpp>
 
 #include "as2_core/frame_utils/frame_utils.hpp"
 #include "as2_core/names/topics.hpp"
 #include "as2_core/node.hpp"
 #include "as2_core/tf_utils.hpp"
+#include "basic_state_estimator/srv/get_state_at_time.hpp"
+#include "error_state_ekf.hpp"
+#include "estimation_modes.hpp"
+#include "estimator_core.hpp"
+#include "fusion_inputs.hpp"
+#include "imu_propagator.hpp"
+#include "instrumentation.hpp"
+#include "lag_compensated_filter.hpp"
+#include "latency_statistics.hpp"
+#include "message_reserve.hpp"
+#include "pose.hpp"
+#include "realtime_loop.hpp"
+#include "state_history.hpp"
+#include "state_snapshot.hpp"
+#include "swarm_kernel.hpp"
+#include "tf_batch.hpp"
+#include "triple_buffer.hpp"
 #include "nav_msgs/msg/odometry.hpp"
 
 class BasicStateEstimator : public as2::Node
 {
 public:
-  BasicStateEstimator();
+  explicit BasicStateEstimator(const rclcpp::NodeOptions &_options = rclcpp::NodeOptions());
+  ~BasicStateEstimator();
 
   void setupNode();
   void cleanupNode();
+  void activateNode();
+  void deactivateNode();
   void setupTfTree();
   void run();
   void getStartingPose(const std::string &_earth_frame, const std::string &_map);
-  void updateOdomTfDrift(const geometry_msgs::msg::Transform _odom2baselink,
-                         const geometry_msgs::msg::Transform _map2baselink);
-  geometry_msgs::msg::Transform calculateLocalization();
+  void updateOdomTfDrift(const basic_state_estimator::Pose &_odom2baselink,
+                         const basic_state_estimator::Pose &_map2baselink);
+  basic_state_estimator::Pose calculateLocalization();
   void publishTfs();
+  void publishStaticTfs();
+
+  /**
+   * @brief Drive run() from a node owned timer instead of as2::spinLoop. The timer is recreated
+   * when the node is configured again after a cleanup.
+   * @param _frequency Timer frequency in Hz
+   */
+  void startRunTimer(const double _frequency);
+
+  /**
+   * @brief Drive run() from a dedicated thread configured by the realtime_* parameters, while
+   * the callbacks keep being served by the executor. Must be stopped before rclcpp::shutdown().
+   * @param _frequency Loop frequency in Hz
+   */
+  void startRealtimeLoop(const double _frequency);
+  void stopRealtimeLoop();
+
+  /**
+   * @brief Hand the transforms to a batch shared with other estimators instead of owning the
+   * tf broadcasters. Must be called before configure.
+   */
+  void setTfBatch(const std::shared_ptr<basic_state_estimator::TfBatch> &_tf_batch);
+
+  /**
+   * @brief Batched estimation for the multi-drone host, the drone math runs in a SwarmKernel
+   * update between both calls. gatherBatch() writes the inputs to the kernel column _index and
+   * returns false if this estimator can not be batched this cycle (no input yet, sensor fusion,
+   * publish on input or a global reference chain read from tf), then run() has to be used.
+   * scatterBatch() must follow every successful gatherBatch() to publish the kernel outputs.
+   */
+  bool gatherBatch(basic_state_estimator::SwarmKernel &_kernel, const std::size_t _index);
+  void scatterBatch(const basic_state_estimator::SwarmKernel &_kernel, const std::size_t _index);
 
 private:
-  std::unique_ptr<tf2_ros::TransformBroadcaster> tf_broadcaster_;
+  // Benchmarks drive the private pipeline stages in isolation
+  friend class BasicStateEstimatorBenchmark;
+
+  rclcpp_lifecycle::LifecyclePublisher<tf2_msgs::msg::TFMessage>::SharedPtr tf_pub_;
   std::shared_ptr<tf2_ros::StaticTransformBroadcaster> tfstatic_broadcaster_;
   std::shared_ptr<tf2_ros::Buffer> tf_buffer_;
   std::shared_ptr<tf2_ros::TransformListener> tf_listener_{nullptr};
+  std::shared_ptr<basic_state_estimator::TfBatch> tf_batch_;
 
-  rclcpp::Subscription<nav_msgs::msg::Odometry>::SharedPtr odom_sub_;
   rclcpp::Subscription<geometry_msgs::msg::PoseStamped>::SharedPtr gt_pose_sub_;
   rclcpp::Subscription<geometry_msgs::msg::TwistStamped>::SharedPtr gt_twist_sub_;
-  rclcpp::Publisher<geometry_msgs::msg::PoseStamped>::SharedPtr pose_estimated_pub_;
-  rclcpp::Publisher<geometry_msgs::msg::TwistStamped>::SharedPtr twist_estimated_pub_;
+  rclcpp::Subscription<sensor_msgs::msg::Imu>::SharedPtr imu_sub_;
+  rclcpp_lifecycle::LifecyclePublisher<geometry_msgs::msg::PoseStamped>::SharedPtr
+      pose_estimated_pub_;
+  rclcpp_lifecycle::LifecyclePublisher<geometry_msgs::msg::TwistStamped>::SharedPtr
+      twist_estimated_pub_;
+  rclcpp_lifecycle::LifecyclePublisher<geometry_msgs::msg::PoseWithCovarianceStamped>::SharedPtr
+      pose_covariance_pub_;
+  rclcpp_lifecycle::LifecyclePublisher<geometry_msgs::msg::TwistWithCovarianceStamped>::SharedPtr
+      twist_covariance_pub_;
+
+  // Driver of run() requested by startRunTimer() or startRealtimeLoop(), 0 Hz if none
+  double run_frequency_ = 0.0;
+  bool realtime_run_ = false;
+  rclcpp::TimerBase::SharedPtr run_timer_;
+  std::unique_ptr<basic_state_estimator::RealtimeLoop> realtime_loop_;
+  basic_state_estimator::RealtimeOptions realtime_options_;
+  void createRunLoop();
+  void startRealtimeThread();
+
+  // Per topic QoS (qos.<topic>.*) over the as2 defaults, with the deadline misses of each topic
+  // counted for the diagnostics
+  enum QosTopic
+  {
+    QOS_ODOM,
+    QOS_GROUND_TRUTH,
+    QOS_IMU,
+    QOS_SELF_LOCALIZATION,
+    QOS_COUNT
+  };
+  std::vector<rclcpp::QoS> qos_;
+  std::array<bool, QOS_COUNT> qos_deadline_{};
+  std::array<std::atomic<uint64_t>, QOS_COUNT> deadlines_missed_{};
+  void setupQos();
+  template <typename OptionsT> OptionsT qosOptions(const QosTopic _topic);
+
+  // Lifecycle: inputs are only handed to the estimation while active. Deactivation keeps the
+  // subscriptions unless release_subscriptions_on_deactivate, so activation resumes at once.
+  std::atomic<bool> active_{false};
+  bool release_subscriptions_ = false;
+  void createSubscriptions();
+  void releaseSubscriptions();
+  template <typename Function> void forEachPublisher(Function _function);
+
+  rclcpp::CallbackGroup::SharedPtr odom_cb_group_;
+  rclcpp::CallbackGroup::SharedPtr ground_truth_cb_group_;
+  rclcpp::CallbackGroup::SharedPtr imu_cb_group_;
+  rclcpp::CallbackGroup::SharedPtr run_cb_group_;
 
-  void odomCallback(const nav_msgs::msg::Odometry::SharedPtr _msg);
+  // Callback -> estimation handoff, lock-free so the estimation never waits on the callbacks
+  struct OdomSample
+  {
+    std::size_t source = 0; // Index in odom_sources_
+    builtin_interfaces::msg::Time stamp;
+    basic_state_estimator::Pose pose;
+    Eigen::Vector3d linear_velocity = Eigen::Vector3d::Zero();  // Body frame
+    Eigen::Vector3d angular_velocity = Eigen::Vector3d::Zero(); // Body frame
+    basic_state_estimator::Matrix6d pose_covariance = basic_state_estimator::Matrix6d::Zero();
+    basic_state_estimator::Matrix6d twist_covariance = basic_state_estimator::Matrix6d::Zero();
+  };
+  basic_state_estimator::TripleBuffer<OdomSample> odom_buffer_;
+  basic_state_estimator::TripleBuffer<geometry_msgs::msg::PoseStamped> gt_pose_buffer_;
+  basic_state_estimator::TripleBuffer<geometry_msgs::msg::TwistStamped> gt_twist_buffer_;
+  bool consumeInputs();
+
+  void odomCallback(const nav_msgs::msg::Odometry::SharedPtr _msg, const std::size_t _source = 0);
   void gtPoseCallback(const geometry_msgs::msg::PoseStamped::SharedPtr _msg);
   void gtTwistCallback(const geometry_msgs::msg::TwistStamped::SharedPtr _msg);
+  void writeGtPose(const geometry_msgs::msg::PoseStamped &_msg);
+  void writeGtTwist(const geometry_msgs::msg::TwistStamped &_msg);
+
+  // Ground truth ingestion (ground_truth_ingestion): on take the ground truth subscriptions are
+  // not served by the executor and run() takes their newest sample
+  bool take_ground_truth_ = false;
+  std::string ground_truth_content_filter_;
+  geometry_msgs::msg::PoseStamped gt_pose_taken_;
+  geometry_msgs::msg::TwistStamped gt_twist_taken_;
+  void takeGroundTruth();
+
+  // Ground truth pairing (ground_truth_pair_by_stamp): a new pose is estimated with the twist of
+  // its stamp, waiting at most one cycle for it
+  bool pair_ground_truth_ = false;
+  bool gt_pose_pending_ = false;
+  bool gt_pose_waited_ = false;
+  basic_state_estimator::StateHistory gt_twist_history_{16};
+  bool pairGroundTruth();
+  void imuCallback(const sensor_msgs::msg::Imu::SharedPtr _msg);
+
+  // Odometry sources (odom_sources) in priority order, only the active one reaches the
+  // estimation. The estimation fails over to the first healthy source when the active one has
+  // no sample for its timeout, and back to a higher priority source once it has delivered again
+  // for odom_source_recovery_time without going stale. Modes with a handover offset continue
+  // from the last estimated pose, and the sensor fusion anchors the odometry increments again on
+  // the first sample of the new source.
+  struct OdomSource
+  {
+    std::string topic;
+    rclcpp::Subscription<nav_msgs::msg::Odometry>::SharedPtr subscription;
+    std::chrono::steady_clock::rep timeout;
+    // Steady clock time of the last sample, 0 before the first one
+    std::atomic<std::chrono::steady_clock::rep> last_receipt{0};
+    // Steady clock time of the first sample since the source was last stale
+    std::atomic<std::chrono::steady_clock::rep> healthy_since{0};
+  };
+  static constexpr std::size_t max_odom_sources = 32;
+  std::vector<OdomSource> odom_sources_;
+  std::atomic<std::size_t> active_odom_source_{0};
+  // Bits of the sources above the active one with a new sample, set by their callbacks
+  std::atomic<uint32_t> recovered_odom_sources_{0};
+  // Source of odom2baselink_
+  std::size_t odom_source_ = 0;
+  std::size_t odom_failovers_ = 0;
+  std::chrono::steady_clock::rep odom_source_recovery_ = 0;
+
+  template <typename ModeT> void arbitrateOdometry();
+  bool isOdomSourceStale(const std::size_t _source,
+                         const std::chrono::steady_clock::rep _now) const;
+  bool isOdomSourceRecovered(const std::size_t _source,
+                             const std::chrono::steady_clock::rep _now) const;
 
   std::vector<geometry_msgs::msg::TransformStamped> tf2_fix_transforms_;
-  geometry_msgs::msg::TransformStamped map2odom_tf_;
-  geometry_msgs::msg::TransformStamped odom2baselink_tf_;
-  geometry_msgs::msg::TwistStamped odom_twist_;
-  geometry_msgs::msg::Pose gt_pose_;
-  geometry_msgs::msg::TwistStamped gt_twist_;
-  geometry_msgs::msg::Pose global_ref_pose;
-  geometry_msgs::msg::TwistStamped global_ref_twist; // TODO:Review
+  std::vector<geometry_msgs::msg::TransformStamped> published_fix_transforms_;
+  // Estimation state, converted from the input messages when consumed and to the output
+  // messages when published
+  basic_state_estimator::Pose map2odom_;
+  basic_state_estimator::Pose odom2baselink_;
+  // Preallocated /tf messages with and without map -> odom, frame ids are set in setupTfTree()
+  tf2_msgs::msg::TFMessage tf_msg_;
+  tf2_msgs::msg::TFMessage odom_tf_msg_;
+
+  // Only send map -> odom when it changes, or after tf_map2odom_keepalive_ seconds
+  bool tf_map2odom_on_change_ = false;
+  double tf_map2odom_keepalive_;
+  basic_state_estimator::Pose last_sent_map2odom_;
+  rclcpp::Time last_sent_map2odom_time_;
+  bool map2odomChanged(const rclcpp::Time &_timestamp) const;
+  builtin_interfaces::msg::Time odom_stamp_;
+  Eigen::Vector3d odom_linear_velocity_ = Eigen::Vector3d::Zero();
+  Eigen::Vector3d odom_angular_velocity_ = Eigen::Vector3d::Zero();
+  basic_state_estimator::Matrix6d odom_pose_covariance_ = basic_state_estimator::Matrix6d::Zero();
+  basic_state_estimator::Matrix6d odom_twist_covariance_ = basic_state_estimator::Matrix6d::Zero();
+  basic_state_estimator::Pose gt_pose_;
+  builtin_interfaces::msg::Time gt_pose_stamp_;
+  Eigen::Vector3d gt_linear_velocity_ = Eigen::Vector3d::Zero();
+  Eigen::Vector3d gt_angular_velocity_ = Eigen::Vector3d::Zero();
+  std::string gt_twist_frame_;
+  basic_state_estimator::Pose global2baselink_;
+  Eigen::Vector3d global_linear_velocity_ = Eigen::Vector3d::Zero();
+  Eigen::Vector3d global_angular_velocity_ = Eigen::Vector3d::Zero();
+  std::string global_twist_frame_; // TODO:Review
 
   bool odom_only_;
   bool ground_truth_;
   bool sensor_fusion_;
-  bool start_run_;
+  std::atomic<bool> start_run_;
+
+  // Publish on input: estimate from the callbacks, rate limited to max_publish_rate_
+  bool publish_on_input_ = false;
+  std::atomic<bool> pending_estimation_{false};
+  std::atomic<bool> estimation_in_progress_{false};
+  std::chrono::steady_clock::duration min_publish_period_;
+  std::atomic<std::chrono::steady_clock::time_point> last_estimation_time_;
+  rclcpp::TimerBase::SharedPtr flush_timer_;
+  std::atomic<bool> flush_armed_{false};
+  bool publishSlotOpen() const;
+  void armFlush();
+  void flushMerged();
+
+  void tryEstimate();
+  void estimate();
+  void onInputReceived();
+
+  // Only estimate and publish when an input has a new sample, with an optional heartbeat
+  bool publish_only_new_data_ = false;
+  std::chrono::steady_clock::duration heartbeat_period_;
+  bool skipCycle(const bool _new_data) const;
+
+  // Stages of the estimation mode in use, selected on activation and on mode switches.
+  // calculateLocalization(), consumeInputs() and getGlobalRefState() dispatch through it.
+  struct Pipeline
+  {
+    void (BasicStateEstimator::*estimate)();
+    bool (BasicStateEstimator::*consume_inputs)();
+    basic_state_estimator::Pose (BasicStateEstimator::*localize)();
+    void (BasicStateEstimator::*global_twist)();
+    void (BasicStateEstimator::*covariance)();
+    std::size_t mode;
+  };
+  Pipeline pipeline_;
+  // The source of the mode had a new sample in this cycle
+  bool source_updated_ = false;
+
+  void selectPipeline();
+  template <typename ModeT> void selectPipeline();
+  template <typename ModeT> void estimatePipeline();
+  // Return true if any input used by the mode had a new sample
+  template <typename ModeT> bool consumeInputsFor();
+  template <typename ModeT> basic_state_estimator::Pose localize();
+  template <typename ModeT> void updateGlobalTwist();
+  template <typename ModeT> void updateCovariance();
+  void updateGlobalPose();
+  bool lookupGlobal2Map();
+
+  // Runtime mode switch: mode parameters set while running are applied by the estimation at
+  // its next cycle. The core offsets the new source (drift convention) so the
+  // estimated pose continues from the last one.
+  rclcpp::node_interfaces::OnSetParametersCallbackHandle::SharedPtr parameters_callback_handle_;
+  std::atomic<int> requested_mode_{-1};
+  std::atomic<bool> fuse_inputs_{false};
+
+  rcl_interfaces::msg::SetParametersResult
+  onParametersSet(const std::vector<rclcpp::Parameter> &_parameters);
+  void applyModeSwitch();
+
+  // Fixed earth -> map chain, composed in memory when every link is owned by this node
+  // Drift, handover and global reference math, shared with offline replays
+  basic_state_estimator::EstimatorCore core_;
+  bool global2map_owned_ = false;
+  // Not owned global -> map is looked up from tf every global_ref_refresh_period_
+  bool global2map_valid_ = false;
+  std::chrono::steady_clock::duration global_ref_refresh_period_;
+  std::chrono::steady_clock::time_point last_global2map_lookup_;
 
   void getGlobalRefState();
+  bool composeFixTransforms(const std::string &_parent_frame, const std::string &_child_frame,
+                            basic_state_estimator::Pose &_parent2child);
 
   std::string global_ref_frame_;
   std::string map_frame_;
   std::string odom_frame_;
   std::string baselink_frame_;
 
-  void publishStateEstimation();
-  geometry_msgs::msg::PoseStamped generatePoseStampedMsg(const rclcpp::Time &_timestamp);
-  geometry_msgs::msg::TwistStamped generateTwistStampedMsg(const rclcpp::Time &_timestamp);
+  // Stamp of the measurement the current estimation comes from
+  rclcpp::Time estimation_stamp_;
+  rclcpp::Time last_sent_tf_stamp_;
+
+  // Reused when the middleware can not loan messages
+  geometry_msgs::msg::PoseStamped pose_msg_;
+  geometry_msgs::msg::TwistStamped twist_msg_;
+  geometry_msgs::msg::PoseWithCovarianceStamped pose_covariance_msg_;
+  geometry_msgs::msg::TwistWithCovarianceStamped twist_covariance_msg_;
+  // Spares handed over to intra-process subscribers, refilled off the publishing thread by
+  // reserve_refill_, which only runs with intra-process comms
+  bool intra_process_ = false;
+  basic_state_estimator::MessageReserve<geometry_msgs::msg::PoseStamped> pose_reserve_;
+  basic_state_estimator::MessageReserve<geometry_msgs::msg::TwistStamped> twist_reserve_;
+  basic_state_estimator::MessageReserve<geometry_msgs::msg::PoseWithCovarianceStamped>
+      pose_covariance_reserve_;
+  basic_state_estimator::MessageReserve<geometry_msgs::msg::TwistWithCovarianceStamped>
+      twist_covariance_reserve_;
+  basic_state_estimator::MessageReserve<tf2_msgs::msg::TFMessage> tf_reserve_;
+  basic_state_estimator::MessageReserve<tf2_msgs::msg::TFMessage> odom_tf_reserve_;
+  basic_state_estimator::ReserveRefill reserve_refill_;
+  void startReserveRefill();
+
+  // Covariance output (publish_covariance): the covariance of the source is rotated to the
+  // global reference frame with the estimate, as fixed size 6x6 products
+  bool publish_covariance_ = false;
+  basic_state_estimator::Matrix6d pose_covariance_ = basic_state_estimator::Matrix6d::Zero();
+  basic_state_estimator::Matrix6d twist_covariance_ = basic_state_estimator::Matrix6d::Zero();
+
+  void publishStateEstimation(const bool _new_data = true);
+  void generatePoseStampedMsg(const rclcpp::Time &_timestamp,
+                              geometry_msgs::msg::PoseStamped &_pose_stamped);
+  void generateTwistStampedMsg(const rclcpp::Time &_timestamp,
+                               geometry_msgs::msg::TwistStamped &_twist_stamped);
+  void generatePoseCovarianceMsg(const rclcpp::Time &_timestamp,
+                                 geometry_msgs::msg::PoseWithCovarianceStamped &_pose);
+  void generateTwistCovarianceMsg(const rclcpp::Time &_timestamp,
+                                  geometry_msgs::msg::TwistWithCovarianceStamped &_twist);
+
+  // IMU propagation: in odom only mode every odometry sample is moved forward with the IMU
+  // samples that follow it, and each IMU sample hands the propagated state to the estimation as
+  // a new odometry sample. Both callbacks then write odom_buffer_, serialized by the mutex.
+  std::atomic<bool> imu_propagation_{false};
+  std::atomic<bool> propagate_imu_{false};
+  std::mutex propagation_mutex_;
+  basic_state_estimator::ImuPropagator imu_propagator_;
+  // Source and covariances of the odometry sample being propagated
+  std::size_t propagated_source_ = 0;
+  basic_state_estimator::Matrix6d propagated_pose_covariance_ =
+      basic_state_estimator::Matrix6d::Zero();
+  basic_state_estimator::Matrix6d propagated_twist_covariance_ =
+      basic_state_estimator::Matrix6d::Zero();
+
+  void writeOdomSample(const nav_msgs::msg::Odometry &_msg, const std::size_t _source);
+  void propagateOdometry(const nav_msgs::msg::Odometry &_msg, const std::size_t _source);
+  bool propagateImu(const sensor_msgs::msg::Imu &_msg);
+  bool publishPropagatedState();
+
+  // Sensor fusion: odometry, IMU and absolute pose (ground_truth/pose) fused in the map frame.
+  // The filter is shared by the input callbacks, the estimation reads its published state.
+  struct FusionState
+  {
+    rclcpp::Time stamp;
+    Eigen::Vector3d position = Eigen::Vector3d::Zero();
+    Eigen::Vector3d velocity = Eigen::Vector3d::Zero();
+    Eigen::Quaterniond orientation = Eigen::Quaterniond::Identity();
+    Eigen::Vector3d angular_velocity = Eigen::Vector3d::Zero();
+    bool imu_active = false;
+    // Orientation part in the map frame axes
+    basic_state_estimator::Matrix6d pose_covariance = basic_state_estimator::Matrix6d::Zero();
+    // Linear part in the map frame, angular part in the body frame
+    basic_state_estimator::Matrix6d twist_covariance = basic_state_estimator::Matrix6d::Zero();
+  };
+  std::mutex fusion_mutex_;
+  basic_state_estimator::TripleBuffer<FusionState> fusion_buffer_;
+  FusionState fusion_state_;
+  basic_state_estimator::LagCompensatedFilter fusion_filter_;
+  basic_state_estimator::FusionParameters fusion_parameters_;
+
+  void setupSensorFusion();
+  void publishFusionState();
+  void fuseOdometry(const nav_msgs::msg::Odometry &_msg, const std::size_t _source);
+  void fuseAbsolutePose(const geometry_msgs::msg::PoseStamped &_msg);
+
+  // Estimated states in the global reference frame, queried by stamp through
+  // self_localization/get_state_at_time
+  basic_state_estimator::StateHistory state_history_;
+  // Twist frames of the samples, indexed by StateSample::twist_frame. The service runs in its
+  // own callback group, it reads them and global_ref_frame_ under state_history_mutex_
+  std::vector<std::string> state_history_frames_;
+  std::mutex state_history_mutex_;
+  rclcpp::CallbackGroup::SharedPtr service_cb_group_;
+  rclcpp::Service<basic_state_estimator::srv::GetStateAtTime>::SharedPtr get_state_srv_;
+
+  void recordState();
+  void getStateAtTimeCallback(
+      const basic_state_estimator::srv::GetStateAtTime::Request::SharedPtr _request,
+      basic_state_estimator::srv::GetStateAtTime::Response::SharedPtr _response);
+
+  // Warm start (snapshot.*): the estimation state is saved every snapshot_period_ to a memory
+  // mapped file, and restored on activation when it is not older than snapshot.max_age
+  basic_state_estimator::StateSnapshot snapshot_;
+  basic_state_estimator::SnapshotState snapshot_state_;
+  bool snapshot_loaded_ = false;
+  std::chrono::steady_clock::duration snapshot_period_;
+  std::chrono::steady_clock::time_point last_snapshot_time_;
+
+  void loadSnapshot();
+  void restoreSnapshot();
+  void saveSnapshot();
+
+  // Input -> publish latency for each estimation mode
+  std::array<basic_state_estimator::LatencyStatistics, 3> latency_stats_;
+  rclcpp_lifecycle::LifecyclePublisher<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr
+      diagnostics_pub_;
+  rclcpp::TimerBase::SharedPtr diagnostics_timer_;
+
+  std::size_t activeMode() const;
+  void publishDiagnostics();
+
+  // Hot path instrumentation, reported with the diagnostics. The macros recording it are
+  // compiled out without BASIC_STATE_ESTIMATOR_INSTRUMENTATION.
+  enum Stage
+  {
+    STAGE_CONSUME,
+    STAGE_LOCALIZE,
+    STAGE_DRIFT,
+    STAGE_PUBLISH_TFS,
+    STAGE_GLOBAL_STATE,
+    STAGE_RECORD,
+    STAGE_PUBLISH,
+    STAGE_ESTIMATE, // Whole estimation cycle
+    STAGE_COUNT
+  };
+  enum Input
+  {
+    INPUT_ODOM,
+    INPUT_GT_POSE,
+    INPUT_GT_TWIST,
+    INPUT_IMU,
+    INPUT_COUNT
+  };
+  std::array<basic_state_estimator::DurationStatistics, STAGE_COUNT> stage_stats_;
+  basic_state_estimator::DurationStatistics odom_age_;
+  std::array<basic_state_estimator::RateCounter, INPUT_COUNT> received_;
+  // Samples overwritten before the estimation took them, or rejected by the filter
+  std::array<basic_state_estimator::RateCounter, INPUT_COUNT> dropped_;
+  // Estimations folded into a later one by the rate limit or a concurrent estimation
+  basic_state_estimator::RateCounter merged_;
+  // Cycles without new input data skipped by publish_only_new_data
+  basic_state_estimator::RateCounter skipped_;
+  basic_state_estimator::RateCounter tf_lookup_failures_;
+#ifdef BASIC_STATE_ESTIMATOR_INSTRUMENTATION
+  diagnostic_msgs::msg::DiagnosticStatus instrumentationStatus();
+#endif
 
   using CallbackReturn = rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::CallbackReturn;
 
   CallbackReturn on_configure(const rclcpp_lifecycle::State &) override;
   CallbackReturn on_activate(const rclcpp_lifecycle::State &) override;
   CallbackReturn on_deactivate(const rclcpp_lifecycle::State &) override;
+  CallbackReturn on_cleanup(const rclcpp_lifecycle::State &) override;
   CallbackReturn on_shutdown(const rclcpp_lifecycle::State &) override;
 };
 
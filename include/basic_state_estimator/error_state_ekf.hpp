@@ -0,0 +1,166 @@
+/*!*******************************************************************************************
+ *  \file       error_state_ekf.hpp
+ *  \brief      Error state EKF for the basic state estimator sensor fusion mode
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef ERROR_STATE_EKF_HPP_
+#define ERROR_STATE_EKF_HPP_
+
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+
+namespace basic_state_estimator
+{
+
+/**
+ * @brief Error state EKF over position, velocity and orientation in the map frame plus IMU
+ * accelerometer and gyroscope biases. The orientation error is expressed in the body frame.
+ * Every matrix is fixed size, so predict and update never allocate.
+ */
+class ErrorStateEkf
+{
+public:
+  static constexpr int StateSize = 15;
+  using ErrorState = Eigen::Matrix<double, StateSize, 1>;
+  using CovarianceMatrix = Eigen::Matrix<double, StateSize, StateSize>;
+  using Matrix6d = Eigen::Matrix<double, 6, 6>;
+
+  // Error state layout
+  static constexpr int POSITION = 0;
+  static constexpr int VELOCITY = 3;
+  static constexpr int ORIENTATION = 6;
+  static constexpr int ACC_BIAS = 9;
+  static constexpr int GYRO_BIAS = 12;
+
+  // Continuous time white noise densities, integrated over each prediction step
+  struct NoiseParameters
+  {
+    double acc_noise = 0.5;         // [m/s^2 / sqrt(Hz)]
+    double gyro_noise = 0.05;       // [rad/s / sqrt(Hz)]
+    double acc_bias_noise = 0.01;   // [m/s^2 / sqrt(s)]
+    double gyro_bias_noise = 0.001; // [rad/s / sqrt(s)]
+  };
+
+  ErrorStateEkf();
+
+  void setNoiseParameters(const NoiseParameters &_noise) { noise_ = _noise; }
+
+  /**
+   * @brief Initialize the state at the given pose, with zero velocity and biases
+   */
+  void reset(const Eigen::Vector3d &_position, const Eigen::Quaterniond &_orientation,
+             const Eigen::Vector3d &_velocity = Eigen::Vector3d::Zero());
+  bool isInitialized() const { return initialized_; }
+
+  /**
+   * @brief Propagate with an IMU sample
+   * @param _acc Specific force in the body frame [m/s^2]
+   * @param _gyro Angular velocity in the body frame [rad/s]
+   * @param _dt Time since the previous propagation [s]
+   */
+  void predict(const Eigen::Vector3d &_acc, const Eigen::Vector3d &_gyro, const double _dt);
+
+  /**
+   * @brief Propagate with a constant velocity model, used while no IMU is available
+   * @param _angular_velocity Body angular velocity held over _dt, e.g. from odometry [rad/s]
+   */
+  void predict(const double _dt,
+               const Eigen::Vector3d &_angular_velocity = Eigen::Vector3d::Zero());
+
+  /**
+   * @brief Update with a pose in the map frame
+   * @param _covariance Position and orientation covariance, orientation in the map frame axes
+   */
+  void updatePose(const Eigen::Vector3d &_position, const Eigen::Quaterniond &_orientation,
+                  const Matrix6d &_covariance);
+  void updatePosition(const Eigen::Vector3d &_position, const Eigen::Matrix3d &_covariance);
+  /**
+   * @brief Update with the linear velocity in the body frame, as given by odometry twists
+   */
+  void updateBodyVelocity(const Eigen::Vector3d &_velocity, const Eigen::Matrix3d &_covariance);
+
+  const Eigen::Vector3d &position() const { return position_; }
+  const Eigen::Vector3d &velocity() const { return velocity_; }
+  const Eigen::Quaterniond &orientation() const { return orientation_; }
+  const Eigen::Vector3d &accBias() const { return acc_bias_; }
+  const Eigen::Vector3d &gyroBias() const { return gyro_bias_; }
+  /**
+   * @brief Last bias corrected angular velocity in the body frame
+   */
+  const Eigen::Vector3d &angularVelocity() const { return angular_velocity_; }
+  const CovarianceMatrix &covariance() const { return covariance_; }
+
+  static Eigen::Matrix3d skew(const Eigen::Vector3d &_v);
+  static Eigen::Quaterniond expMap(const Eigen::Vector3d &_rotation);
+  static Eigen::Vector3d logMap(const Eigen::Quaterniond &_q);
+
+private:
+  NoiseParameters noise_;
+  bool initialized_;
+  Eigen::Vector3d gravity_;
+
+  Eigen::Vector3d position_;
+  Eigen::Vector3d velocity_;
+  Eigen::Quaterniond orientation_;
+  Eigen::Vector3d acc_bias_;
+  Eigen::Vector3d gyro_bias_;
+  Eigen::Vector3d angular_velocity_;
+  CovarianceMatrix covariance_;
+
+  template <int M>
+  void update(const Eigen::Matrix<double, M, 1> &_residual,
+              const Eigen::Matrix<double, M, StateSize> &_H,
+              const Eigen::Matrix<double, M, M> &_R);
+  void injectErrorState(const ErrorState &_dx);
+  void addProcessNoise(const double _dt);
+};
+
+template <int M>
+void ErrorStateEkf::update(const Eigen::Matrix<double, M, 1> &_residual,
+                           const Eigen::Matrix<double, M, StateSize> &_H,
+                           const Eigen::Matrix<double, M, M> &_R)
+{
+  const Eigen::Matrix<double, StateSize, M> PHt = covariance_ * _H.transpose();
+  const Eigen::Matrix<double, M, M> S = _H * PHt + _R;
+  const Eigen::Matrix<double, StateSize, M> K = S.ldlt().solve(PHt.transpose()).transpose();
+
+  // Joseph form keeps the covariance symmetric and positive definite
+  const CovarianceMatrix IKH = CovarianceMatrix::Identity() - K * _H;
+  covariance_ = IKH * covariance_ * IKH.transpose() + K * _R * K.transpose();
+  injectErrorState(K * _residual);
+}
+
+} // namespace basic_state_estimator
+
+#endif // ERROR_STATE_EKF_HPP_
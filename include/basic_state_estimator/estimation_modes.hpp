@@ -0,0 +1,99 @@
+/*!*******************************************************************************************
+ *  \file       estimation_modes.hpp
+ *  \brief      Estimation modes of the basic state estimator
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef ESTIMATION_MODES_HPP_
+#define ESTIMATION_MODES_HPP_
+
+#include <cstddef>
+
+namespace basic_state_estimator
+{
+
+/*
+ * Estimation mode strategies. BasicStateEstimator specializes its pipeline stages on them and
+ * selects one pipeline when activated or when the mode is switched, so the estimation cycle does
+ * not branch on the mode. A new mode is a strategy type, the specializations of its localization
+ * and global twist stages, and its entry in BasicStateEstimator::selectPipeline().
+ *
+ * index: mode of activeMode() and the diagnostics
+ * uses_odometry, uses_ground_truth, uses_fusion: inputs consumed by the estimation
+ * offset_on_switch: the source gets the handover offset when switched to
+ * velocity_frame: frame of the linear velocity of the source
+ */
+
+enum class VelocityFrame
+{
+  BODY,
+  MAP,
+  GLOBAL
+};
+
+// map -> base_link is the odometry, map -> odom holds only the handover offset
+struct OdomOnlyMode
+{
+  static constexpr std::size_t index = 0;
+  static constexpr bool uses_odometry = true;
+  static constexpr bool uses_ground_truth = false;
+  static constexpr bool uses_fusion = false;
+  static constexpr bool offset_on_switch = true;
+  static constexpr VelocityFrame velocity_frame = VelocityFrame::BODY;
+};
+
+// Ground truth pose is published as odom -> base_link; odometry is not used
+struct GroundTruthMode
+{
+  static constexpr std::size_t index = 1;
+  static constexpr bool uses_odometry = false;
+  static constexpr bool uses_ground_truth = true;
+  static constexpr bool uses_fusion = false;
+  static constexpr bool offset_on_switch = true;
+  static constexpr VelocityFrame velocity_frame = VelocityFrame::GLOBAL;
+};
+
+// Filter state as map -> base_link, odometry as odom -> base_link
+struct SensorFusionMode
+{
+  static constexpr std::size_t index = 2;
+  static constexpr bool uses_odometry = true;
+  static constexpr bool uses_ground_truth = false;
+  static constexpr bool uses_fusion = true;
+  static constexpr bool offset_on_switch = false;
+  static constexpr VelocityFrame velocity_frame = VelocityFrame::MAP;
+};
+
+} // namespace basic_state_estimator
+
+#endif // ESTIMATION_MODES_HPP_
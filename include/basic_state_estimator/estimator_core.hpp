@@ -0,0 +1,146 @@
+/*!*******************************************************************************************
+ *  \file       estimator_core.hpp
+ *  \brief      Estimation math of the basic state estimator, independent of the node
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef ESTIMATOR_CORE_HPP_
+#define ESTIMATOR_CORE_HPP_
+
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+
+#include "estimation_modes.hpp"
+#include "pose.hpp"
+
+namespace basic_state_estimator
+{
+
+/**
+ * @brief map -> odom that moves _odom2baselink onto _map2baselink, map2baselink * odom2baselink^-1
+ * so that applying it is the same composition as the published map -> odom -> base_link chain
+ */
+Pose driftBetween(const Pose &_odom2baselink, const Pose &_map2baselink);
+
+/**
+ * @brief Estimation state of BasicStateEstimator that does not depend on the node: the handover
+ * between pose sources and the global reference. Everything is driven by the message stamps and
+ * values, so the same math runs on the node and on offline replays.
+ */
+class EstimatorCore
+{
+public:
+  void reset();
+
+  void setGlobal2Map(const Pose &_global2map) { global2map_ = _global2map; }
+  const Pose &global2map() const { return global2map_; }
+
+  /**
+   * @brief Switch the pose source. The first new sample of the next source is offset so the
+   * estimated pose continues from the last one.
+   */
+  void beginHandover();
+  bool hasMap2Baselink() const { return map2baselink_valid_; }
+  const Pose &lastMap2Baselink() const { return last_map2baselink_; }
+
+  // Offset applied to the active source since the last handover, false if there is none
+  bool modeOffset(Pose &_mode_offset) const
+  {
+    _mode_offset = mode_offset_;
+    return mode_offset_active_;
+  }
+
+  /**
+   * @brief Resume from a saved state, as if localize had last returned _map2baselink
+   */
+  void restore(const Pose &_map2baselink, const Pose &_mode_offset, const bool _offset_active);
+
+  /**
+   * @brief map -> base_link from a sample of the active source
+   * @param _offset_on_switch Apply the handover offset to this source
+   * @param _new_sample The source had a new sample since the previous call
+   */
+  const Pose &localize(const Pose &_source2baselink, const bool _offset_on_switch,
+                       const bool _new_sample);
+
+  // localize() for the source of a mode strategy, see estimation_modes.hpp
+  template <typename ModeT>
+  const Pose &localize(const Pose &_source2baselink, const bool _new_sample)
+  {
+    return localize(_source2baselink, ModeT::offset_on_switch, _new_sample);
+  }
+
+  // Global reference -> base_link through global -> map -> odom -> base_link
+  Pose globalPose(const Pose &_map2odom, const Pose &_odom2baselink) const
+  {
+    return compose(compose(global2map_, _map2odom), _odom2baselink);
+  }
+
+  Eigen::Vector3d mapToGlobal(const Eigen::Vector3d &_vector) const
+  {
+    return global2map_.orientation * _vector;
+  }
+
+  // Linear velocity of the source of a mode strategy in the global reference frame
+  template <typename ModeT>
+  Eigen::Vector3d globalVelocity(const Pose &_global2baselink,
+                                 const Eigen::Vector3d &_velocity) const
+  {
+    if (ModeT::velocity_frame == VelocityFrame::BODY)
+    {
+      return _global2baselink.orientation * _velocity;
+    }
+    if (ModeT::velocity_frame == VelocityFrame::MAP)
+    {
+      return mapToGlobal(_velocity);
+    }
+    if (ModeT::offset_on_switch && mode_offset_active_)
+    {
+      // The handover offset turns the trajectory of the source, and its velocity with it
+      return mode_offset_.orientation * _velocity;
+    }
+    return _velocity;
+  }
+
+private:
+  Pose global2map_;
+  Pose mode_offset_;
+  bool mode_offset_active_ = false;
+  bool handover_pending_ = false;
+  Pose last_map2baselink_;
+  bool map2baselink_valid_ = false;
+};
+
+} // namespace basic_state_estimator
+
+#endif // ESTIMATOR_CORE_HPP_
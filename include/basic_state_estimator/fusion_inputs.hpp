@@ -0,0 +1,100 @@
+/*!*******************************************************************************************
+ *  \file       fusion_inputs.hpp
+ *  \brief      Sensor fusion inputs of the basic state estimator
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef FUSION_INPUTS_HPP_
+#define FUSION_INPUTS_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <Eigen/Dense>
+
+#include "error_state_ekf.hpp"
+#include "lag_compensated_filter.hpp"
+#include "pose.hpp"
+
+namespace basic_state_estimator
+{
+
+// Defaults of the node fusion.* parameters
+struct FusionParameters
+{
+  ErrorStateEkf::NoiseParameters noise;
+  // Standard deviations used when a measurement has no covariance
+  double odom_position_std = 0.05;    // [m]
+  double odom_orientation_std = 0.05; // [rad]
+  double odom_velocity_std = 0.1;     // [m/s]
+  double pose_position_std = 0.01;    // [m]
+  double pose_orientation_std = 0.02; // [rad]
+  double imu_timeout = 0.1;           // [s]
+  std::size_t replay_window = 256;
+  std::size_t max_replay_depth = 64;
+};
+
+/**
+ * @brief Filter configured with _parameters, uninitialized until the first odometry or absolute
+ * pose
+ */
+LagCompensatedFilter makeFusionFilter(const FusionParameters &_parameters);
+
+// Raise the diagonal of a [position, orientation] covariance to the given standard deviations
+void applyMinimumStd(Matrix6d &_covariance, const double _position_std,
+                     const double _orientation_std);
+
+/**
+ * @brief Fuse an odometry sample as the increment since the previous sample of _source, see
+ * LagCompensatedFilter::addOdometry
+ * @param _map2odom Drift the filter starts with when this sample initializes it
+ * @param _pose_covariance Odometry pose covariance, in the odom frame
+ * @param _twist_covariance Odometry twist covariance, in the body frame
+ * @return false if the filter dropped the sample
+ */
+bool fuseOdometry(LagCompensatedFilter &_filter, const FusionParameters &_parameters,
+                  const int64_t _stamp, const std::size_t _source, const Pose &_map2odom,
+                  const Pose &_odom2baselink, const Eigen::Vector3d &_body_velocity,
+                  const Eigen::Vector3d &_body_angular_velocity, const Matrix6d &_pose_covariance,
+                  const Matrix6d &_twist_covariance);
+
+/**
+ * @brief Fuse an absolute map -> base_link pose without covariance
+ * @return false if the filter dropped the sample
+ */
+bool fuseAbsolutePose(LagCompensatedFilter &_filter, const FusionParameters &_parameters,
+                      const int64_t _stamp, const Pose &_map2baselink);
+
+} // namespace basic_state_estimator
+
+#endif // FUSION_INPUTS_HPP_
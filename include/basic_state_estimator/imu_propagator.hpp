@@ -0,0 +1,136 @@
+/*!*******************************************************************************************
+ *  \file       imu_propagator.hpp
+ *  \brief      IMU preintegration between odometry samples
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef IMU_PROPAGATOR_HPP_
+#define IMU_PROPAGATOR_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+
+namespace basic_state_estimator
+{
+
+struct PropagatedState
+{
+  int64_t stamp = 0; // [ns]
+  Eigen::Vector3d position = Eigen::Vector3d::Zero();
+  Eigen::Quaterniond orientation = Eigen::Quaterniond::Identity();
+  Eigen::Vector3d velocity = Eigen::Vector3d::Zero();         // Odometry frame
+  Eigen::Vector3d angular_velocity = Eigen::Vector3d::Zero(); // Body frame
+};
+
+/**
+ * @brief Propagates the last odometry sample with the IMU samples that follow it. The IMU is
+ * preintegrated in the body frame of the odometry sample, so each new odometry sample only
+ * resets the anchor and integrates again the few IMU samples newer than it. IMU axes are
+ * assumed aligned with the base link and the accelerometer to measure specific force.
+ * Storage is allocated once, adding samples never allocates.
+ */
+class ImuPropagator
+{
+public:
+  explicit ImuPropagator(const std::size_t _buffer_size = 128);
+
+  // IMU samples further than this from the anchor are not integrated [ns]
+  void setMaxHorizon(const int64_t _max_horizon) { max_horizon_ = _max_horizon; }
+  void clear();
+  bool isAnchored() const { return anchored_; }
+
+  /**
+   * @brief Anchor the propagation on an odometry sample
+   * @param _velocity Linear velocity in the odometry frame
+   * @param _angular_velocity Angular velocity in the body frame, until the next IMU sample
+   */
+  void reset(const int64_t _stamp, const Eigen::Vector3d &_position,
+             const Eigen::Quaterniond &_orientation, const Eigen::Vector3d &_velocity,
+             const Eigen::Vector3d &_angular_velocity);
+
+  /**
+   * @brief Add an IMU sample, kept for the next anchors and integrated on the current one
+   * @return true if the propagated state moved to this sample, false if it is not newer than the
+   * previous sample, there is no anchor yet or the anchor is older than the max horizon
+   */
+  bool addImu(const int64_t _stamp, const Eigen::Vector3d &_linear_acceleration,
+              const Eigen::Vector3d &_angular_velocity);
+
+  // Anchor moved to the newest integrated IMU sample
+  const PropagatedState &state() const { return state_; }
+  std::size_t integratedSamples() const { return integrated_samples_; }
+
+private:
+  struct ImuSample
+  {
+    int64_t stamp = 0;
+    Eigen::Vector3d linear_acceleration = Eigen::Vector3d::Zero();
+    Eigen::Vector3d angular_velocity = Eigen::Vector3d::Zero();
+  };
+
+  // Motion since the anchor, in the anchor body frame and without gravity
+  struct Preintegration
+  {
+    double dt = 0.0;
+    Eigen::Vector3d dp = Eigen::Vector3d::Zero();
+    Eigen::Vector3d dv = Eigen::Vector3d::Zero();
+    Eigen::Quaterniond dq = Eigen::Quaterniond::Identity();
+  };
+
+  std::vector<ImuSample> samples_;
+  std::size_t first_ = 0;
+  std::size_t size_ = 0;
+  int64_t max_horizon_ = 100000000;
+
+  bool anchored_ = false;
+  PropagatedState anchor_;
+  Preintegration preintegration_;
+  int64_t last_integrated_stamp_ = 0;
+  std::size_t integrated_samples_ = 0;
+  PropagatedState state_;
+
+  const ImuSample &at(const std::size_t _index) const
+  {
+    return samples_[(first_ + _index) % samples_.size()];
+  }
+  bool integrate(const ImuSample &_sample);
+  void predict();
+};
+
+} // namespace basic_state_estimator
+
+#endif // IMU_PROPAGATOR_HPP_
@@ -0,0 +1,160 @@
+/*!*******************************************************************************************
+ *  \file       instrumentation.hpp
+ *  \brief      Low overhead hot path instrumentation for the basic state estimator
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef INSTRUMENTATION_HPP_
+#define INSTRUMENTATION_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace basic_state_estimator
+{
+
+/**
+ * @brief Count, total and maximum of a duration measured on the hot path. Written by one thread
+ * and taken by the reporting one with relaxed atomics, no locks.
+ */
+class DurationStatistics
+{
+public:
+  void add(const int64_t _ns)
+  {
+    count_.fetch_add(1, std::memory_order_relaxed);
+    total_ns_.fetch_add(_ns, std::memory_order_relaxed);
+    if (_ns > max_ns_.load(std::memory_order_relaxed))
+    {
+      max_ns_.store(_ns, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * @brief Statistics since the previous call
+   * @return false if nothing was measured
+   */
+  bool take(double &_mean_us, double &_max_us)
+  {
+    const int64_t count = count_.exchange(0, std::memory_order_relaxed);
+    const int64_t total_ns = total_ns_.exchange(0, std::memory_order_relaxed);
+    const int64_t max_ns = max_ns_.exchange(0, std::memory_order_relaxed);
+    if (count == 0)
+    {
+      return false;
+    }
+    _mean_us = 1e-3 * static_cast<double>(total_ns) / static_cast<double>(count);
+    _max_us = 1e-3 * static_cast<double>(max_ns);
+    return true;
+  }
+
+private:
+  std::atomic<int64_t> count_{0};
+  std::atomic<int64_t> total_ns_{0};
+  std::atomic<int64_t> max_ns_{0};
+};
+
+/**
+ * @brief Adds the monotonic time spent in its scope to a DurationStatistics
+ */
+class ScopedTimer
+{
+public:
+  explicit ScopedTimer(DurationStatistics &_statistics)
+      : statistics_(_statistics), start_(std::chrono::steady_clock::now())
+  {
+  }
+  ~ScopedTimer()
+  {
+    statistics_.add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start_)
+                        .count());
+  }
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+private:
+  DurationStatistics &statistics_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+/**
+ * @brief Event counter that also estimates the event rate between two reports
+ */
+class RateCounter
+{
+public:
+  void increment() { total_.fetch_add(1, std::memory_order_relaxed); }
+  uint64_t total() const { return total_.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Events per second since the previous call
+   */
+  double takeRate(const std::chrono::steady_clock::time_point &_now)
+  {
+    const uint64_t total = this->total();
+    const double elapsed = std::chrono::duration<double>(_now - last_time_).count();
+    const double rate = last_time_ == std::chrono::steady_clock::time_point() || elapsed <= 0.0
+                            ? 0.0
+                            : static_cast<double>(total - last_total_) / elapsed;
+    last_total_ = total;
+    last_time_ = _now;
+    return rate;
+  }
+
+private:
+  std::atomic<uint64_t> total_{0};
+  // Only used by the reporting thread
+  uint64_t last_total_ = 0;
+  std::chrono::steady_clock::time_point last_time_;
+};
+
+} // namespace basic_state_estimator
+
+// Compiled out unless BASIC_STATE_ESTIMATOR_INSTRUMENTATION is defined
+#ifdef BASIC_STATE_ESTIMATOR_INSTRUMENTATION
+#define BSE_CONCAT_IMPL(_a, _b) _a##_b
+#define BSE_CONCAT(_a, _b) BSE_CONCAT_IMPL(_a, _b)
+#define BSE_SCOPED_TIMER(_statistics)                                                            \
+  basic_state_estimator::ScopedTimer BSE_CONCAT(scoped_timer_, __LINE__)(_statistics)
+#define BSE_COUNT(_counter) (_counter).increment()
+#define BSE_RECORD(_statistics, _ns) (_statistics).add(_ns)
+#else
+#define BSE_SCOPED_TIMER(_statistics) ((void)0)
+#define BSE_COUNT(_counter) ((void)0)
+#define BSE_RECORD(_statistics, _ns) ((void)0)
+#endif
+
+#endif // INSTRUMENTATION_HPP_
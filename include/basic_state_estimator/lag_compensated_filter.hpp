@@ -0,0 +1,189 @@
+/*!*******************************************************************************************
+ *  \file       lag_compensated_filter.hpp
+ *  \brief      Sensor fusion with bounded replay of delayed measurements
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef LAG_COMPENSATED_FILTER_HPP_
+#define LAG_COMPENSATED_FILTER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "error_state_ekf.hpp"
+
+namespace basic_state_estimator
+{
+
+/**
+ * @brief ErrorStateEkf fed with stamped inputs that may arrive out of order. A preallocated
+ * window keeps every input with the filter state after it. An input older than the newest one
+ * restores the state before its stamp and re-applies only the suffix after it. The suffix is
+ * bounded by the maximum replay depth, so the worst case cost of an input is fixed; inputs that
+ * would need a longer replay, or that are older than the window, are dropped.
+ */
+class LagCompensatedFilter
+{
+public:
+  /**
+   * @param _window Inputs kept for replay
+   * @param _max_replay_depth Maximum number of inputs re-applied for a delayed one. With 0
+   * nothing is replayed and delayed inputs are applied on the current state.
+   */
+  explicit LagCompensatedFilter(const std::size_t _window = 256,
+                                const std::size_t _max_replay_depth = 64);
+
+  void setNoiseParameters(const ErrorStateEkf::NoiseParameters &_noise)
+  {
+    noise_ = _noise;
+    current_.ekf.setNoiseParameters(_noise);
+  }
+  /**
+   * @param _imu_timeout Time without IMU after which the constant velocity model is used [ns]
+   */
+  void setImuTimeout(const int64_t _imu_timeout) { imu_timeout_ = _imu_timeout; }
+
+  /**
+   * @brief Start from the given state, clearing the window
+   * @param _velocity Linear velocity in the map frame
+   */
+  void initialize(const int64_t _stamp, const Eigen::Vector3d &_position,
+                  const Eigen::Quaterniond &_orientation,
+                  const Eigen::Vector3d &_velocity = Eigen::Vector3d::Zero());
+  bool isInitialized() const { return current_.ekf.isInitialized(); }
+  /**
+   * @brief Back to uninitialized, clearing the window
+   */
+  void clear();
+
+  // Each returns false if the input was dropped
+  bool addImu(const int64_t _stamp, const Eigen::Vector3d &_acc, const Eigen::Vector3d &_gyro);
+  bool addPose(const int64_t _stamp, const Eigen::Vector3d &_position,
+               const Eigen::Quaterniond &_orientation, const ErrorStateEkf::Matrix6d &_covariance);
+  /**
+   * @brief Pose in the odom frame of _source, linear and angular velocity in the body frame. The
+   * angular velocity is held by the constant velocity model until the next odometry. The pose is
+   * fused as the increment since the previous sample of the same source, applied on the filter
+   * state at that sample, so no map -> odom drift is fed back from the filter output. The first
+   * sample of a source only anchors the increments.
+   * @param _pose_covariance Covariance of the increment, orientation in the odom frame axes
+   */
+  bool addOdometry(const int64_t _stamp, const std::size_t _source,
+                   const Eigen::Vector3d &_position, const Eigen::Quaterniond &_orientation,
+                   const ErrorStateEkf::Matrix6d &_pose_covariance,
+                   const Eigen::Vector3d &_velocity, const Eigen::Matrix3d &_velocity_covariance,
+                   const Eigen::Vector3d &_angular_velocity = Eigen::Vector3d::Zero());
+
+  const ErrorStateEkf &filter() const { return current_.ekf; }
+  // Stamp of the filter state [ns]
+  int64_t stamp() const { return current_.stamp; }
+  bool isImuActive() const { return isImuActive(current_, current_.stamp); }
+
+  std::size_t replayedInputs() const { return replayed_inputs_; }
+  std::size_t droppedInputs() const { return dropped_inputs_; }
+
+private:
+  // Last odometry sample and the filter state after it
+  struct OdometryAnchor
+  {
+    bool valid = false;
+    std::size_t source = 0;
+    Eigen::Vector3d odom_position = Eigen::Vector3d::Zero();
+    Eigen::Quaterniond odom_orientation = Eigen::Quaterniond::Identity();
+    Eigen::Vector3d position = Eigen::Vector3d::Zero();
+    Eigen::Quaterniond orientation = Eigen::Quaterniond::Identity();
+    // Pose covariance, orientation in the map frame axes
+    ErrorStateEkf::Matrix6d covariance = ErrorStateEkf::Matrix6d::Zero();
+  };
+
+  struct FilterState
+  {
+    ErrorStateEkf ekf;
+    int64_t stamp = 0;
+    int64_t last_imu_stamp = 0;
+    bool imu_received = false;
+    // Last IMU sample, held to propagate up to the stamp of a measurement
+    Eigen::Vector3d imu_acc = Eigen::Vector3d::Zero();
+    Eigen::Vector3d imu_gyro = Eigen::Vector3d::Zero();
+    // Last odometry angular velocity, for the constant velocity model
+    Eigen::Vector3d odom_angular_velocity = Eigen::Vector3d::Zero();
+    OdometryAnchor odometry_anchor;
+  };
+
+  enum class InputType
+  {
+    IMU,
+    POSE,
+    ODOMETRY
+  };
+
+  struct Input
+  {
+    InputType type = InputType::IMU;
+    int64_t stamp = 0;
+    std::size_t source = 0; // Odometry source
+    Eigen::Vector3d vector_a = Eigen::Vector3d::Zero(); // Acceleration or position
+    Eigen::Vector3d vector_b = Eigen::Vector3d::Zero(); // Angular or linear velocity
+    Eigen::Vector3d angular_velocity = Eigen::Vector3d::Zero(); // Odometry angular velocity
+    Eigen::Quaterniond orientation = Eigen::Quaterniond::Identity();
+    ErrorStateEkf::Matrix6d pose_covariance = ErrorStateEkf::Matrix6d::Zero();
+    Eigen::Matrix3d velocity_covariance = Eigen::Matrix3d::Zero();
+    FilterState state; // After applying the input
+  };
+
+  std::vector<Input> window_;
+  std::size_t first_;
+  std::size_t size_;
+  std::size_t max_replay_depth_;
+  int64_t imu_timeout_;
+  ErrorStateEkf::NoiseParameters noise_;
+  FilterState current_;
+  Input input_;
+
+  std::size_t replayed_inputs_;
+  std::size_t dropped_inputs_;
+
+  Input &at(const std::size_t _index) { return window_[(first_ + _index) % window_.size()]; }
+  bool add(const Input &_input);
+  void apply(const Input &_input, FilterState &_state) const;
+  void applyOdometry(const Input &_input, FilterState &_state) const;
+  bool isImuActive(const FilterState &_state, const int64_t _stamp) const
+  {
+    return _state.imu_received && _stamp - _state.last_imu_stamp < imu_timeout_;
+  }
+};
+
+} // namespace basic_state_estimator
+
+#endif // LAG_COMPENSATED_FILTER_HPP_
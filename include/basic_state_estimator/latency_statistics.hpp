@@ -0,0 +1,110 @@
+/*!*******************************************************************************************
+ *  \file       latency_statistics.hpp
+ *  \brief      Fixed window latency statistics for the basic state estimator
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef LATENCY_STATISTICS_HPP_
+#define LATENCY_STATISTICS_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace basic_state_estimator
+{
+
+/**
+ * @brief Keeps the last N latency samples and reports their percentiles.
+ * Storage is allocated once in the constructor, so adding samples never allocates.
+ */
+class LatencyStatistics
+{
+public:
+  explicit LatencyStatistics(const std::size_t _window = 1000)
+      : samples_(_window), scratch_(_window), next_(0), count_(0)
+  {
+  }
+
+  void addSample(const double _latency)
+  {
+    samples_[next_] = _latency;
+    next_ = (next_ + 1) % samples_.size();
+    count_ = std::min(count_ + 1, samples_.size());
+  }
+
+  std::size_t count() const { return count_; }
+
+  void reset()
+  {
+    next_ = 0;
+    count_ = 0;
+  }
+
+  /**
+   * @brief Percentiles of the samples in the window
+   * @return false if there are no samples
+   */
+  bool getPercentiles(double &_p50, double &_p99, double &_max)
+  {
+    if (count_ == 0)
+    {
+      return false;
+    }
+    auto first = scratch_.begin();
+    auto last = scratch_.begin() + count_;
+    std::copy(samples_.begin(), samples_.begin() + count_, first);
+    _p50 = percentile(first, last, 0.50);
+    _p99 = percentile(first, last, 0.99);
+    _max = *std::max_element(first, last);
+    return true;
+  }
+
+private:
+  std::vector<double> samples_;
+  std::vector<double> scratch_;
+  std::size_t next_;
+  std::size_t count_;
+
+  static double percentile(std::vector<double>::iterator _first,
+                           std::vector<double>::iterator _last, const double _ratio)
+  {
+    auto nth = _first + static_cast<std::ptrdiff_t>(_ratio * (std::distance(_first, _last) - 1));
+    std::nth_element(_first, nth, _last);
+    return *nth;
+  }
+};
+
+} // namespace basic_state_estimator
+
+#endif // LATENCY_STATISTICS_HPP_
@@ -0,0 +1,188 @@
+/*!*******************************************************************************************
+ *  \file       message_reserve.hpp
+ *  \brief      Preallocated messages for the intra-process publishers
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef MESSAGE_RESERVE_HPP_
+#define MESSAGE_RESERVE_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace basic_state_estimator
+{
+
+class ReserveRefill;
+
+class MessageReserveBase
+{
+public:
+  virtual ~MessageReserveBase() = default;
+  // Allocate spare messages until the reserve is full, only called by the refill thread
+  virtual void refill() = 0;
+
+protected:
+  friend class ReserveRefill;
+  ReserveRefill *refill_thread_ = nullptr;
+
+  void notifyRefill();
+};
+
+/**
+ * @brief Spare messages handed over as unique_ptrs to intra-process publishing, which keeps the
+ * ownership of every published message. The spares are allocated ahead by a ReserveRefill
+ * thread, so publishing only takes one. Single consumer, the publishing thread, and single
+ * producer, the refill thread.
+ */
+template <typename MessageT> class MessageReserve : public MessageReserveBase
+{
+public:
+  explicit MessageReserve(const std::size_t _capacity = 4) : slots_(_capacity + 1) {}
+
+  MessageReserve(const MessageReserve &) = delete;
+  MessageReserve &operator=(const MessageReserve &) = delete;
+
+  /**
+   * @brief Take a spare message, a copy of the last prototype, and wake up the refill thread
+   * @return Spare message, or nullptr if the reserve ran out
+   */
+  std::unique_ptr<MessageT> take()
+  {
+    const std::size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire))
+    {
+      notifyRefill();
+      return nullptr;
+    }
+    std::unique_ptr<MessageT> msg = std::move(slots_[head]);
+    head_.store(next(head), std::memory_order_release);
+    notifyRefill();
+    return msg;
+  }
+
+  /**
+   * @brief Spares are copies of the prototype, so filling them reuses the storage of their
+   * strings and sequences. Skipped while the refill thread is copying it, never blocks.
+   */
+  void updatePrototype(const MessageT &_msg)
+  {
+    std::unique_lock<std::mutex> lock(prototype_mutex_, std::try_to_lock);
+    if (lock.owns_lock())
+    {
+      prototype_ = _msg;
+    }
+  }
+
+  // Consumer side, true once the refill thread has replaced every spare taken
+  bool full() const
+  {
+    return next(tail_.load(std::memory_order_acquire)) == head_.load(std::memory_order_relaxed);
+  }
+
+  void refill() override
+  {
+    std::lock_guard<std::mutex> lock(prototype_mutex_);
+    std::size_t tail = tail_.load(std::memory_order_relaxed);
+    while (next(tail) != head_.load(std::memory_order_acquire))
+    {
+      slots_[tail] = std::make_unique<MessageT>(prototype_);
+      tail = next(tail);
+      tail_.store(tail, std::memory_order_release);
+    }
+  }
+
+private:
+  // One slot is always empty to tell a full ring from an empty one
+  std::vector<std::unique_ptr<MessageT>> slots_;
+  std::atomic<std::size_t> head_{0};
+  std::atomic<std::size_t> tail_{0};
+  std::mutex prototype_mutex_;
+  MessageT prototype_;
+
+  std::size_t next(const std::size_t _index) const
+  {
+    return _index + 1 == slots_.size() ? 0 : _index + 1;
+  }
+};
+
+/**
+ * @brief Thread that refills the registered reserves when they hand out a message. Wake ups
+ * are not locked on the publishing side, one that is missed is caught by the next period.
+ */
+class ReserveRefill
+{
+public:
+  explicit ReserveRefill(
+      const std::chrono::milliseconds _period = std::chrono::milliseconds(5));
+  ~ReserveRefill();
+
+  ReserveRefill(const ReserveRefill &) = delete;
+  ReserveRefill &operator=(const ReserveRefill &) = delete;
+
+  // Fill the reserves and start the thread, stopping the previous one if any
+  void start(const std::vector<MessageReserveBase *> &_reserves);
+  void stop();
+  void notify();
+
+  bool isRunning() const { return running_.load(std::memory_order_relaxed); }
+
+private:
+  const std::chrono::milliseconds period_;
+  std::vector<MessageReserveBase *> reserves_;
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+  std::atomic<bool> pending_{false};
+  std::mutex mutex_;
+  std::condition_variable wake_up_;
+
+  void loop();
+};
+
+inline void MessageReserveBase::notifyRefill()
+{
+  if (refill_thread_)
+  {
+    refill_thread_->notify();
+  }
+}
+
+} // namespace basic_state_estimator
+
+#endif // MESSAGE_RESERVE_HPP_
@@ -0,0 +1,178 @@
+/*!*******************************************************************************************
+ *  \file       pose.hpp
+ *  \brief      Internal pose representation of the estimation and its message conversions
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef POSE_HPP_
+#define POSE_HPP_
+
+#include <array>
+
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+
+#include <geometry_msgs/msg/point.hpp>
+#include <geometry_msgs/msg/pose.hpp>
+#include <geometry_msgs/msg/quaternion.hpp>
+#include <geometry_msgs/msg/transform.hpp>
+#include <geometry_msgs/msg/vector3.hpp>
+
+namespace basic_state_estimator
+{
+
+/**
+ * @brief Rigid transform parent -> child. The estimation works on these from the input
+ * callbacks to the publishers, messages are only converted at both edges. Orientations must be
+ * normalized.
+ */
+struct Pose
+{
+  Eigen::Vector3d position = Eigen::Vector3d::Zero();
+  Eigen::Quaterniond orientation = Eigen::Quaterniond::Identity();
+};
+
+// parent -> child -> grandchild from parent -> child and child -> grandchild
+inline Pose compose(const Pose &_lhs, const Pose &_rhs)
+{
+  Pose pose;
+  pose.position = _lhs.position + _lhs.orientation * _rhs.position;
+  pose.orientation = _lhs.orientation * _rhs.orientation;
+  return pose;
+}
+
+// child -> parent from parent -> child
+inline Pose inverse(const Pose &_pose)
+{
+  Pose pose;
+  pose.orientation = _pose.orientation.conjugate();
+  pose.position = -(pose.orientation * _pose.position);
+  return pose;
+}
+
+// Covariance of [linear, angular] as in the ROS messages
+using Matrix6d = Eigen::Matrix<double, 6, 6>;
+
+// Covariance with its linear and angular parts rotated to new frames
+inline Matrix6d rotateCovariance(const Matrix6d &_covariance, const Eigen::Matrix3d &_linear,
+                                 const Eigen::Matrix3d &_angular)
+{
+  Matrix6d rotation = Matrix6d::Zero();
+  rotation.block<3, 3>(0, 0) = _linear;
+  rotation.block<3, 3>(3, 3) = _angular;
+  return rotation * _covariance * rotation.transpose();
+}
+
+// MESSAGE CONVERSIONS //
+
+inline Eigen::Vector3d fromMsg(const geometry_msgs::msg::Vector3 &_vector)
+{
+  return Eigen::Vector3d(_vector.x, _vector.y, _vector.z);
+}
+
+inline Eigen::Vector3d fromMsg(const geometry_msgs::msg::Point &_point)
+{
+  return Eigen::Vector3d(_point.x, _point.y, _point.z);
+}
+
+inline Eigen::Quaterniond fromMsg(const geometry_msgs::msg::Quaternion &_quaternion)
+{
+  return Eigen::Quaterniond(_quaternion.w, _quaternion.x, _quaternion.y, _quaternion.z);
+}
+
+inline Pose fromMsg(const geometry_msgs::msg::Transform &_transform)
+{
+  Pose pose;
+  pose.position = fromMsg(_transform.translation);
+  pose.orientation = fromMsg(_transform.rotation);
+  return pose;
+}
+
+inline Pose fromMsg(const geometry_msgs::msg::Pose &_msg)
+{
+  Pose pose;
+  pose.position = fromMsg(_msg.position);
+  pose.orientation = fromMsg(_msg.orientation);
+  return pose;
+}
+
+// Message covariances are row major
+inline Matrix6d covarianceFromMsg(const std::array<double, 36> &_covariance)
+{
+  return Eigen::Map<const Eigen::Matrix<double, 6, 6, Eigen::RowMajor>>(_covariance.data());
+}
+
+// Written in place so the preallocated output messages are reused
+
+inline void toMsg(const Eigen::Vector3d &_vector, geometry_msgs::msg::Vector3 &_msg)
+{
+  _msg.x = _vector.x();
+  _msg.y = _vector.y();
+  _msg.z = _vector.z();
+}
+
+inline void toMsg(const Eigen::Vector3d &_vector, geometry_msgs::msg::Point &_msg)
+{
+  _msg.x = _vector.x();
+  _msg.y = _vector.y();
+  _msg.z = _vector.z();
+}
+
+inline void toMsg(const Eigen::Quaterniond &_quaternion, geometry_msgs::msg::Quaternion &_msg)
+{
+  _msg.x = _quaternion.x();
+  _msg.y = _quaternion.y();
+  _msg.z = _quaternion.z();
+  _msg.w = _quaternion.w();
+}
+
+inline void toMsg(const Pose &_pose, geometry_msgs::msg::Transform &_msg)
+{
+  toMsg(_pose.position, _msg.translation);
+  toMsg(_pose.orientation, _msg.rotation);
+}
+
+inline void toMsg(const Pose &_pose, geometry_msgs::msg::Pose &_msg)
+{
+  toMsg(_pose.position, _msg.position);
+  toMsg(_pose.orientation, _msg.orientation);
+}
+
+inline void toMsg(const Matrix6d &_covariance, std::array<double, 36> &_msg)
+{
+  Eigen::Map<Eigen::Matrix<double, 6, 6, Eigen::RowMajor>>(_msg.data()) = _covariance;
+}
+
+} // namespace basic_state_estimator
+
+#endif // POSE_HPP_
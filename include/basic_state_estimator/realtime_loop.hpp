@@ -0,0 +1,103 @@
+/*!*******************************************************************************************
+ *  \file       realtime_loop.hpp
+ *  \brief      Real-time periodic loop thread for the estimation
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef REALTIME_LOOP_HPP_
+#define REALTIME_LOOP_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "instrumentation.hpp"
+
+namespace basic_state_estimator
+{
+
+struct RealtimeOptions
+{
+  int priority = 80;       // SCHED_FIFO priority, 1 to 99, or 0 to keep the default scheduler
+  int cpu = -1;            // CPU the loop thread is pinned to, -1 to let the scheduler choose
+  bool lock_memory = true; // mlockall the process so the loop never page faults
+};
+
+/**
+ * @brief Runs a function at a fixed period on its own thread, sleeping until absolute deadlines
+ * of CLOCK_MONOTONIC so the period does not drift with the cycle time. Cycles that overrun the
+ * next deadline are skipped rather than run back to back.
+ */
+class RealtimeLoop
+{
+public:
+  RealtimeLoop(const std::chrono::nanoseconds _period, std::function<void()> _cycle);
+  ~RealtimeLoop();
+
+  RealtimeLoop(const RealtimeLoop &) = delete;
+  RealtimeLoop &operator=(const RealtimeLoop &) = delete;
+
+  /**
+   * @brief Start the loop thread. The loop runs even if the real-time settings can not be
+   * applied, usually for lack of CAP_SYS_NICE or of memlock limits.
+   * @return Settings that could not be applied, empty if all of them were
+   */
+  std::string start(const RealtimeOptions &_options);
+  void stop();
+
+  bool isRunning() const { return running_.load(std::memory_order_relaxed); }
+  bool isRealtime() const { return realtime_.load(std::memory_order_relaxed); }
+
+  // Wake up delay after each deadline
+  DurationStatistics &wakeUpJitter() { return jitter_; }
+  uint64_t overruns() const { return overruns_.load(std::memory_order_relaxed); }
+
+private:
+  const std::chrono::nanoseconds period_;
+  std::function<void()> cycle_;
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+  std::atomic<bool> realtime_{false};
+  DurationStatistics jitter_;
+  std::atomic<uint64_t> overruns_{0};
+
+  std::string applyThreadOptions(const RealtimeOptions &_options);
+  void loop();
+};
+
+} // namespace basic_state_estimator
+
+#endif // REALTIME_LOOP_HPP_
@@ -0,0 +1,170 @@
+/*!*******************************************************************************************
+ *  \file       state_history.hpp
+ *  \brief      Time indexed history of estimated states
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef STATE_HISTORY_HPP_
+#define STATE_HISTORY_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+
+namespace basic_state_estimator
+{
+
+struct StateSample
+{
+  int64_t stamp = 0; // [ns]
+  Eigen::Vector3d position = Eigen::Vector3d::Zero();
+  Eigen::Quaterniond orientation = Eigen::Quaterniond::Identity();
+  Eigen::Vector3d linear_velocity = Eigen::Vector3d::Zero();
+  Eigen::Vector3d angular_velocity = Eigen::Vector3d::Zero();
+  // Frame of the velocities, an index into a frame table kept by the owner of the history
+  std::size_t twist_frame = 0;
+};
+
+/**
+ * @brief Fixed capacity ring buffer of states ordered by stamp. Storage is allocated once, the
+ * oldest sample is overwritten when full and lookups are O(log n).
+ */
+class StateHistory
+{
+public:
+  explicit StateHistory(const std::size_t _capacity = 1000)
+      : samples_(_capacity), first_(0), size_(0)
+  {
+  }
+
+  std::size_t size() const { return size_; }
+  std::size_t capacity() const { return samples_.size(); }
+  void clear() { first_ = size_ = 0; }
+
+  const StateSample &oldest() const { return at(0); }
+  const StateSample &newest() const { return at(size_ - 1); }
+
+  /**
+   * @brief Append a sample
+   * @return false if it is not newer than the last sample
+   */
+  bool push(const StateSample &_sample)
+  {
+    if (samples_.empty() || (size_ > 0 && _sample.stamp <= newest().stamp))
+    {
+      return false;
+    }
+    if (size_ < samples_.size())
+    {
+      samples_[(first_ + size_) % samples_.size()] = _sample;
+      size_++;
+    }
+    else
+    {
+      samples_[first_] = _sample;
+      first_ = (first_ + 1) % samples_.size();
+    }
+    return true;
+  }
+
+  /**
+   * @brief State at the given stamp, interpolated between the two surrounding samples
+   * @return false if the stamp is out of the history
+   */
+  bool lookup(const int64_t _stamp, StateSample &_sample) const
+  {
+    if (size_ == 0 || _stamp < oldest().stamp || _stamp > newest().stamp)
+    {
+      return false;
+    }
+    // First sample with stamp >= _stamp
+    std::size_t low = 0;
+    std::size_t high = size_ - 1;
+    while (low < high)
+    {
+      const std::size_t mid = low + (high - low) / 2;
+      if (at(mid).stamp < _stamp)
+      {
+        low = mid + 1;
+      }
+      else
+      {
+        high = mid;
+      }
+    }
+    const StateSample &after = at(low);
+    if (after.stamp == _stamp || low == 0)
+    {
+      _sample = after;
+      return true;
+    }
+    const StateSample &before = at(low - 1);
+    const double ratio = static_cast<double>(_stamp - before.stamp) /
+                         static_cast<double>(after.stamp - before.stamp);
+    _sample.stamp = _stamp;
+    _sample.position = before.position + ratio * (after.position - before.position);
+    _sample.orientation = before.orientation.slerp(ratio, after.orientation);
+    if (before.twist_frame != after.twist_frame)
+    {
+      // Velocities in different frames are not interpolated, the nearest sample gives them
+      const StateSample &nearest = ratio < 0.5 ? before : after;
+      _sample.twist_frame = nearest.twist_frame;
+      _sample.linear_velocity = nearest.linear_velocity;
+      _sample.angular_velocity = nearest.angular_velocity;
+      return true;
+    }
+    _sample.twist_frame = after.twist_frame;
+    _sample.linear_velocity =
+        before.linear_velocity + ratio * (after.linear_velocity - before.linear_velocity);
+    _sample.angular_velocity =
+        before.angular_velocity + ratio * (after.angular_velocity - before.angular_velocity);
+    return true;
+  }
+
+private:
+  std::vector<StateSample> samples_;
+  std::size_t first_;
+  std::size_t size_;
+
+  const StateSample &at(const std::size_t _index) const
+  {
+    return samples_[(first_ + _index) % samples_.size()];
+  }
+};
+
+} // namespace basic_state_estimator
+
+#endif // STATE_HISTORY_HPP_
@@ -0,0 +1,144 @@
+/*!*******************************************************************************************
+ *  \file       state_snapshot.hpp
+ *  \brief      Memory mapped snapshot of the estimation state for warm starts
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef STATE_SNAPSHOT_HPP_
+#define STATE_SNAPSHOT_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "pose.hpp"
+
+namespace basic_state_estimator
+{
+
+// Plain arrays so the file layout does not depend on Eigen
+struct SnapshotPose
+{
+  double position[3];
+  double orientation[4]; // x, y, z, w
+};
+
+struct SnapshotVector
+{
+  double values[3];
+};
+
+/**
+ * @brief Estimation state needed to resume the estimate after a restart
+ */
+struct SnapshotState
+{
+  int64_t stamp;     // [ns] Stamp of the last estimate
+  uint32_t mode;     // Estimation mode index
+  uint32_t mode_offset_active;
+  SnapshotPose global2map; // Starting pose
+  SnapshotPose map2odom;
+  SnapshotPose odom2baselink;
+  SnapshotPose map2baselink;
+  SnapshotPose mode_offset;
+  SnapshotVector odom_linear_velocity;
+  SnapshotVector odom_angular_velocity;
+  SnapshotVector global_linear_velocity;
+  SnapshotVector global_angular_velocity;
+};
+
+/**
+ * @brief Fixed size file mapped in memory holding the last SnapshotState. A write is a copy to
+ * the mapping, which the kernel keeps if the process dies, so it is cheap enough for the
+ * estimation loop. A sequence number and a checksum reject snapshots torn by a crash.
+ */
+class StateSnapshot
+{
+public:
+  StateSnapshot() = default;
+  ~StateSnapshot();
+
+  StateSnapshot(const StateSnapshot &) = delete;
+  StateSnapshot &operator=(const StateSnapshot &) = delete;
+
+  /**
+   * @brief Map the file, created if it does not exist
+   * @return Error, empty on success
+   */
+  std::string open(const std::string &_path);
+  void close();
+  bool isOpen() const { return file_ != nullptr; }
+
+  void write(const SnapshotState &_state);
+
+  /**
+   * @return false if the file holds no complete snapshot
+   */
+  bool read(SnapshotState &_state) const;
+
+private:
+  struct File;
+  File *file_ = nullptr;
+  int fd_ = -1;
+};
+
+inline SnapshotPose toSnapshot(const Pose &_pose)
+{
+  return {{_pose.position.x(), _pose.position.y(), _pose.position.z()},
+          {_pose.orientation.x(), _pose.orientation.y(), _pose.orientation.z(),
+           _pose.orientation.w()}};
+}
+
+inline SnapshotVector toSnapshot(const Eigen::Vector3d &_vector)
+{
+  return {{_vector.x(), _vector.y(), _vector.z()}};
+}
+
+inline Pose fromSnapshot(const SnapshotPose &_pose)
+{
+  Pose pose;
+  pose.position = Eigen::Vector3d(_pose.position[0], _pose.position[1], _pose.position[2]);
+  pose.orientation = Eigen::Quaterniond(_pose.orientation[3], _pose.orientation[0],
+                                        _pose.orientation[1], _pose.orientation[2]);
+  pose.orientation.normalize();
+  return pose;
+}
+
+inline Eigen::Vector3d fromSnapshot(const SnapshotVector &_vector)
+{
+  return Eigen::Vector3d(_vector.values[0], _vector.values[1], _vector.values[2]);
+}
+
+} // namespace basic_state_estimator
+
+#endif // STATE_SNAPSHOT_HPP_
@@ -0,0 +1,112 @@
+/*!*******************************************************************************************
+ *  \file       swarm_kernel.hpp
+ *  \brief      Structure of arrays estimation kernel for the multi-drone host
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef SWARM_KERNEL_HPP_
+#define SWARM_KERNEL_HPP_
+
+#include <cstddef>
+
+#include <Eigen/Dense>
+
+namespace basic_state_estimator
+{
+
+// One column per drone
+struct VectorArrays
+{
+  Eigen::ArrayXd x, y, z;
+
+  void resize(const std::size_t _size);
+};
+
+struct PoseArrays
+{
+  Eigen::ArrayXd x, y, z;
+  Eigen::ArrayXd qx, qy, qz, qw;
+
+  void resize(const std::size_t _size);
+};
+
+/**
+ * @brief Estimation math of every hosted drone in one pass over structure of arrays storage, so
+ * each operation runs as a vectorized loop over the drones. Inputs are written by the estimators,
+ * update() computes the outputs, and the estimators convert them to messages only to publish.
+ * Quaternions must be normalized.
+ */
+class SwarmKernel
+{
+public:
+  explicit SwarmKernel(const std::size_t _size = 0) { resize(_size); }
+
+  void resize(const std::size_t _size);
+  std::size_t size() const { return size_; }
+
+  /**
+   * @brief For every drone: map -> odom drift from odom -> base_link and the estimated
+   * map -> base_link, global -> base_link through global -> map, and the body linear velocity
+   * (FLU) in the global frame (ENU)
+   */
+  void update();
+
+  // Inputs
+  PoseArrays odom2baselink;
+  PoseArrays map2baselink;
+  PoseArrays global2map;
+  VectorArrays body_velocity;
+
+  // Outputs
+  PoseArrays map2odom;
+  PoseArrays global2baselink;
+  VectorArrays global_velocity;
+
+private:
+  std::size_t size_ = 0;
+  PoseArrays global2odom_;
+  VectorArrays cross_;
+
+  // _out = _lhs * _rhs, _out must not be an input
+  static void compose(const PoseArrays &_lhs, const PoseArrays &_rhs, PoseArrays &_out,
+                      VectorArrays &_cross);
+  // (_out_x, _out_y, _out_z) = rotation of _pose applied to (_x, _y, _z), outputs must not be
+  // inputs
+  static void rotate(const PoseArrays &_pose, const Eigen::ArrayXd &_x, const Eigen::ArrayXd &_y,
+                     const Eigen::ArrayXd &_z, Eigen::ArrayXd &_out_x, Eigen::ArrayXd &_out_y,
+                     Eigen::ArrayXd &_out_z, VectorArrays &_cross);
+};
+
+} // namespace basic_state_estimator
+
+#endif // SWARM_KERNEL_HPP_
@@ -0,0 +1,112 @@
+/*!*******************************************************************************************
+ *  \file       tf_batch.hpp
+ *  \brief      Transforms of several estimators sent as one /tf message
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef TF_BATCH_HPP_
+#define TF_BATCH_HPP_
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include <tf2_ros/static_transform_broadcaster.h>
+#include <tf2_ros/transform_broadcaster.h>
+
+#include <geometry_msgs/msg/transform_stamped.hpp>
+
+namespace basic_state_estimator
+{
+
+/**
+ * @brief Collects the transforms of the estimators hosted in one process so each cycle sends a
+ * single /tf message, and /tf_static only when a hosted estimator changed its static transforms.
+ */
+class TfBatch
+{
+public:
+  explicit TfBatch(const std::size_t _expected_transforms = 0)
+  {
+    transforms_.reserve(_expected_transforms);
+    sending_.reserve(_expected_transforms);
+  }
+
+  void add(const std::vector<geometry_msgs::msg::TransformStamped> &_transforms)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    transforms_.insert(transforms_.end(), _transforms.begin(), _transforms.end());
+  }
+
+  void addStatic(const std::vector<geometry_msgs::msg::TransformStamped> &_transforms)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    static_transforms_.insert(static_transforms_.end(), _transforms.begin(), _transforms.end());
+  }
+
+  /**
+   * @brief Send everything added since the last flush. The static broadcaster keeps the latest
+   * transform of every child frame, so only the changed ones are passed to it.
+   */
+  void flush(tf2_ros::TransformBroadcaster &_broadcaster,
+             tf2_ros::StaticTransformBroadcaster &_static_broadcaster)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      // Swapping keeps the capacity of both buffers, the estimators are not blocked while sending
+      sending_.swap(transforms_);
+      sending_static_.swap(static_transforms_);
+    }
+    if (!sending_.empty())
+    {
+      _broadcaster.sendTransform(sending_);
+      sending_.clear();
+    }
+    if (!sending_static_.empty())
+    {
+      _static_broadcaster.sendTransform(sending_static_);
+      sending_static_.clear();
+    }
+  }
+
+private:
+  std::mutex mutex_;
+  std::vector<geometry_msgs::msg::TransformStamped> transforms_;
+  std::vector<geometry_msgs::msg::TransformStamped> static_transforms_;
+  std::vector<geometry_msgs::msg::TransformStamped> sending_;
+  std::vector<geometry_msgs::msg::TransformStamped> sending_static_;
+};
+
+} // namespace basic_state_estimator
+
+#endif // TF_BATCH_HPP_
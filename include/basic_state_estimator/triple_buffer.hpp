@@ -0,0 +1,98 @@
+/*!*******************************************************************************************
+ *  \file       triple_buffer.hpp
+ *  \brief      Lock-free single producer, single consumer triple buffer
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#ifndef TRIPLE_BUFFER_HPP_
+#define TRIPLE_BUFFER_HPP_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace basic_state_estimator
+{
+
+/**
+ * @brief Hands the latest sample from one producer thread to one consumer thread. Neither side
+ * ever blocks or sees a torn sample; samples the consumer does not pick up are overwritten.
+ * Producer: fill write() and then publish(). Consumer: update() and then read().
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+  TripleBuffer() : back_(0), middle_(1), front_(2) {}
+
+  T &write() { return buffers_[back_]; }
+
+  /**
+   * @return true if it overwrote a sample the consumer did not pick up
+   */
+  bool publish()
+  {
+    const std::uint8_t previous = middle_.exchange(back_ | NEW_DATA, std::memory_order_acq_rel);
+    back_ = previous & INDEX_MASK;
+    return (previous & NEW_DATA) != 0;
+  }
+
+  /**
+   * @brief Take the last published sample, if any
+   * @return true if read() changed since the previous call
+   */
+  bool update()
+  {
+    if ((middle_.load(std::memory_order_relaxed) & NEW_DATA) == 0)
+    {
+      return false;
+    }
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & INDEX_MASK;
+    return true;
+  }
+
+  const T &read() const { return buffers_[front_]; }
+
+private:
+  static constexpr std::uint8_t INDEX_MASK = 0x3;
+  static constexpr std::uint8_t NEW_DATA = 0x4;
+
+  std::array<T, 3> buffers_;
+  std::uint8_t back_;
+  std::atomic<std::uint8_t> middle_;
+  std::uint8_t front_;
+};
+
+} // namespace basic_state_estimator
+
+#endif // TRIPLE_BUFFER_HPP_
@@ -0,0 +1,77 @@
+from launch import LaunchDescription
+from launch_ros.actions import ComposableNodeContainer, LoadComposableNodes
+from launch_ros.descriptions import ComposableNode
+from launch.actions import DeclareLaunchArgument
+from launch.conditions import LaunchConfigurationEquals, LaunchConfigurationNotEquals
+from launch.substitutions import LaunchConfiguration
+
+# qos.<topic>.<setting> parameters, each one set by the qos_<topic>_<setting> argument
+QOS_TOPICS = ['odom', 'ground_truth', 'imu', 'self_localization']
+QOS_SETTINGS = [('reliability', 'default'), ('depth', '0'), ('deadline', '0.0'),
+                ('lifespan', '0.0')]
+
+
+def qos_arguments():
+    return [DeclareLaunchArgument('qos_' + topic + '_' + setting, default_value=default)
+            for topic in QOS_TOPICS for setting, default in QOS_SETTINGS]
+
+
+def qos_parameters():
+    return [{'qos.' + topic + '.' + setting: LaunchConfiguration('qos_' + topic + '_' + setting)}
+            for topic in QOS_TOPICS for setting, _ in QOS_SETTINGS]
+
+
+def generate_launch_description():
+    estimator = ComposableNode(
+        package='basic_state_estimator',
+        plugin='BasicStateEstimatorComponent',
+        name='basic_state_estimator',
+        namespace=LaunchConfiguration('drone_id'),
+        parameters=[{'odom_only': LaunchConfiguration('odom_only')},
+                    {'ground_truth': LaunchConfiguration('ground_truth')},
+                    {'sensor_fusion': LaunchConfiguration('sensor_fusion')},
+                    {'base_frame': LaunchConfiguration('base_frame')},
+                    {'publish_on_input': LaunchConfiguration('publish_on_input')},
+                    {'max_publish_rate': LaunchConfiguration('max_publish_rate')},
+                    {'publish_only_new_data': LaunchConfiguration('publish_only_new_data')},
+                    {'heartbeat_rate': LaunchConfiguration('heartbeat_rate')},
+                    {'imu_propagation.enabled': LaunchConfiguration('imu_propagation')},
+                    {'ground_truth_ingestion': LaunchConfiguration('ground_truth_ingestion')},
+                    {'snapshot.path': LaunchConfiguration('snapshot_path')},
+                    *qos_parameters()],
+        extra_arguments=[{'use_intra_process_comms': True}]
+    )
+
+    return LaunchDescription([
+        DeclareLaunchArgument('drone_id', default_value='drone0'),
+        DeclareLaunchArgument('odom_only', default_value='False'),
+        DeclareLaunchArgument('ground_truth', default_value='False'),
+        DeclareLaunchArgument('sensor_fusion', default_value='False'),
+        DeclareLaunchArgument('base_frame', default_value='base_link'),
+        DeclareLaunchArgument('publish_on_input', default_value='False'),
+        DeclareLaunchArgument('max_publish_rate', default_value='200.0'),
+        DeclareLaunchArgument('publish_only_new_data', default_value='False'),
+        DeclareLaunchArgument('heartbeat_rate', default_value='0.0'),
+        DeclareLaunchArgument('imu_propagation', default_value='False'),
+        DeclareLaunchArgument('ground_truth_ingestion', default_value='callback'),
+        DeclareLaunchArgument('snapshot_path', default_value=''),
+        *qos_arguments(),
+        # Name of an existing container to load into, e.g. the motion controller one.
+        # A new container is created if empty.
+        DeclareLaunchArgument('container', default_value=''),
+        ComposableNodeContainer(
+            name='basic_state_estimator_container',
+            namespace=LaunchConfiguration('drone_id'),
+            package='rclcpp_components',
+            executable='component_container',
+            composable_node_descriptions=[estimator],
+            output='screen',
+            emulate_tty=True,
+            condition=LaunchConfigurationEquals('container', '')
+        ),
+        LoadComposableNodes(
+            target_container=LaunchConfiguration('container'),
+            composable_node_descriptions=[estimator],
+            condition=LaunchConfigurationNotEquals('container', '')
+        )
+    ])
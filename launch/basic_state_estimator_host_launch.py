@@ -0,0 +1,35 @@
+from launch import LaunchDescription
+from launch_ros.actions import Node
+from launch.actions import DeclareLaunchArgument
+from launch.substitutions import LaunchConfiguration
+
+
+def generate_launch_description():
+    # No node name or namespace: remaps given to the process would apply to every hosted
+    # estimator, each one is placed in its drone namespace by the host
+    return LaunchDescription([
+        DeclareLaunchArgument('drone_ids', default_value="['drone0']"),
+        DeclareLaunchArgument('frequency', default_value='100.0'),
+        DeclareLaunchArgument('batched', default_value='True'),
+        DeclareLaunchArgument('odom_only', default_value='False'),
+        DeclareLaunchArgument('ground_truth', default_value='False'),
+        DeclareLaunchArgument('sensor_fusion', default_value='False'),
+        DeclareLaunchArgument('base_frame', default_value='base_link'),
+        DeclareLaunchArgument('publish_on_input', default_value='False'),
+        DeclareLaunchArgument('max_publish_rate', default_value='200.0'),
+        Node(
+            package='basic_state_estimator',
+            executable='basic_state_estimator_host',
+            parameters=[{'drone_ids': LaunchConfiguration('drone_ids')},
+                        {'frequency': LaunchConfiguration('frequency')},
+                        {'batched': LaunchConfiguration('batched')},
+                        {'odom_only': LaunchConfiguration('odom_only')},
+                        {'ground_truth': LaunchConfiguration('ground_truth')},
+                        {'sensor_fusion': LaunchConfiguration('sensor_fusion')},
+                        {'base_frame': LaunchConfiguration('base_frame')},
+                        {'publish_on_input': LaunchConfiguration('publish_on_input')},
+                        {'max_publish_rate': LaunchConfiguration('max_publish_rate')}],
+            output='screen',
+            emulate_tty=True
+        )
+    ])
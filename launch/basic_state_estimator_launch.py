@@ -3,6 +3,21 @@ from launch_ros.actions import Node
 from launch.actions import DeclareLaunchArgument
 from launch.substitutions import LaunchConfiguration
 
+# qos.<topic>.<setting> parameters, each one set by the qos_<topic>_<setting> argument
+QOS_TOPICS = ['odom', 'ground_truth', 'imu', 'self_localization']
+QOS_SETTINGS = [('reliability', 'default'), ('depth', '0'), ('deadline', '0.0'),
+                ('lifespan', '0.0')]
+
+
+def qos_arguments():
+    return [DeclareLaunchArgument('qos_' + topic + '_' + setting, default_value=default)
+            for topic in QOS_TOPICS for setting, default in QOS_SETTINGS]
+
+
+def qos_parameters():
+    return [{'qos.' + topic + '.' + setting: LaunchConfiguration('qos_' + topic + '_' + setting)}
+            for topic in QOS_TOPICS for setting, _ in QOS_SETTINGS]
+
 
 def generate_launch_description():
     return LaunchDescription([
@@ -11,6 +26,17 @@ def generate_launch_description():
         DeclareLaunchArgument('ground_truth', default_value='False'),
         DeclareLaunchArgument('sensor_fusion', default_value='False'),
         DeclareLaunchArgument('base_frame', default_value='base_link'),
+        DeclareLaunchArgument('publish_on_input', default_value='False'),
+        DeclareLaunchArgument('max_publish_rate', default_value='200.0'),
+        DeclareLaunchArgument('publish_only_new_data', default_value='False'),
+        DeclareLaunchArgument('heartbeat_rate', default_value='0.0'),
+        DeclareLaunchArgument('imu_propagation', default_value='False'),
+        DeclareLaunchArgument('ground_truth_ingestion', default_value='callback'),
+        DeclareLaunchArgument('snapshot_path', default_value=''),
+        DeclareLaunchArgument('realtime', default_value='False'),
+        DeclareLaunchArgument('realtime_priority', default_value='80'),
+        DeclareLaunchArgument('realtime_cpu', default_value='-1'),
+        *qos_arguments(),
         Node(
             package='basic_state_estimator',
             executable='basic_state_estimator_node',
@@ -19,7 +45,20 @@ def generate_launch_description():
             parameters=[{'odom_only': LaunchConfiguration('odom_only')},
                         {'ground_truth': LaunchConfiguration('ground_truth')},
                         {'sensor_fusion': LaunchConfiguration('sensor_fusion')},
-                        {'base_frame': LaunchConfiguration('base_frame')}],
+                        {'base_frame': LaunchConfiguration('base_frame')},
+                        {'publish_on_input': LaunchConfiguration('publish_on_input')},
+                        {'max_publish_rate': LaunchConfiguration('max_publish_rate')},
+                        {'publish_only_new_data':
+                            LaunchConfiguration('publish_only_new_data')},
+                        {'heartbeat_rate': LaunchConfiguration('heartbeat_rate')},
+                        {'imu_propagation.enabled': LaunchConfiguration('imu_propagation')},
+                        {'ground_truth_ingestion':
+                            LaunchConfiguration('ground_truth_ingestion')},
+                        {'snapshot.path': LaunchConfiguration('snapshot_path')},
+                        {'realtime': LaunchConfiguration('realtime')},
+                        {'realtime_priority': LaunchConfiguration('realtime_priority')},
+                        {'realtime_cpu': LaunchConfiguration('realtime_cpu')},
+                        *qos_parameters()],
             output='screen',
             emulate_tty=True
         )
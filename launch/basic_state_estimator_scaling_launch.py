@@ -0,0 +1,91 @@
+from launch import LaunchDescription
+from launch_ros.actions import ComposableNodeContainer, Node
+from launch_ros.descriptions import ComposableNode
+from launch.actions import DeclareLaunchArgument, EmitEvent, OpaqueFunction, RegisterEventHandler
+from launch.event_handlers import OnProcessExit
+from launch.events import Shutdown
+from launch.substitutions import LaunchConfiguration
+
+# Executable whose processes the driver measures for each deployment
+PROCESS_NAMES = {
+    'processes': 'basic_state_estimator_node',
+    'composed': 'component_container',
+    'host': 'basic_state_estimator_host',
+}
+
+
+def launch_deployment(context):
+    deployment = LaunchConfiguration('deployment').perform(context)
+    drones = int(LaunchConfiguration('drones').perform(context))
+    drone_ids = ['drone' + str(i) for i in range(drones)]
+    parameters = {'odom_only': True,
+                  'publish_on_input': LaunchConfiguration('publish_on_input'),
+                  'max_publish_rate': LaunchConfiguration('max_publish_rate')}
+    if deployment not in PROCESS_NAMES:
+        raise RuntimeError('Unknown deployment ' + deployment + ', expected one of ' +
+                           ', '.join(PROCESS_NAMES))
+
+    if deployment == 'processes':
+        estimators = [Node(
+            package='basic_state_estimator',
+            executable='basic_state_estimator_node',
+            name='basic_state_estimator',
+            namespace=drone_id,
+            parameters=[parameters]
+        ) for drone_id in drone_ids]
+    elif deployment == 'composed':
+        estimators = [ComposableNodeContainer(
+            name='basic_state_estimator_container',
+            namespace='',
+            package='rclcpp_components',
+            executable='component_container',
+            composable_node_descriptions=[ComposableNode(
+                package='basic_state_estimator',
+                plugin='BasicStateEstimatorComponent',
+                name='basic_state_estimator',
+                namespace=drone_id,
+                parameters=[parameters],
+                extra_arguments=[{'use_intra_process_comms': True}]
+            ) for drone_id in drone_ids]
+        )]
+    else:
+        estimators = [Node(
+            package='basic_state_estimator',
+            executable='basic_state_estimator_host',
+            parameters=[parameters, {'drone_ids': drone_ids}]
+        )]
+
+    driver = Node(
+        package='basic_state_estimator',
+        executable='basic_state_estimator_scaling_driver',
+        parameters=[{'deployment': deployment},
+                    {'process_name': PROCESS_NAMES[deployment]},
+                    {'drones': drones},
+                    {'odom_rate': LaunchConfiguration('odom_rate')},
+                    {'warmup': LaunchConfiguration('warmup')},
+                    {'duration': LaunchConfiguration('duration')},
+                    {'output': LaunchConfiguration('output')}],
+        output='screen',
+        emulate_tty=True
+    )
+    # The run is over once the driver has written its results
+    shutdown = RegisterEventHandler(OnProcessExit(
+        target_action=driver, on_exit=[EmitEvent(event=Shutdown(reason='benchmark done'))]))
+    return estimators + [driver, shutdown]
+
+
+def generate_launch_description():
+    return LaunchDescription([
+        # processes: one estimator process per drone, composed: every estimator in a single
+        # component container, host: every estimator in a basic_state_estimator_host
+        DeclareLaunchArgument('deployment', default_value='processes'),
+        DeclareLaunchArgument('drones', default_value='1'),
+        DeclareLaunchArgument('odom_rate', default_value='100.0'),
+        DeclareLaunchArgument('warmup', default_value='2.0'),
+        DeclareLaunchArgument('duration', default_value='10.0'),
+        # Results are appended as one JSON line per run
+        DeclareLaunchArgument('output', default_value='scaling_results.jsonl'),
+        DeclareLaunchArgument('publish_on_input', default_value='True'),
+        DeclareLaunchArgument('max_publish_rate', default_value='200.0'),
+        OpaqueFunction(function=launch_deployment)
+    ])
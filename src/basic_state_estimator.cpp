@@ -34,317 +34,2306 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  ********************************************************************************/
 
+#include <type_traits>
+
 #include "basic_state_estimator.hpp"
 
-BasicStateEstimator::BasicStateEstimator() : as2::Node("basic_state_estimator")
+namespace
+{
+// Indexed by BasicStateEstimator::activeMode()
+constexpr std::array<const char *, 3> mode_names = {"odom_only", "ground_truth", "sensor_fusion"};
+// Indexed by BasicStateEstimator::QosTopic
+constexpr std::array<const char *, 4> qos_names = {"odom", "ground_truth", "imu",
+                                                   "self_localization"};
+
+#ifdef BASIC_STATE_ESTIMATOR_INSTRUMENTATION
+// Indexed by BasicStateEstimator::Stage and BasicStateEstimator::Input
+constexpr std::array<const char *, 8> stage_names = {
+    "consume", "localize", "drift", "publish_tfs", "global_state", "record", "publish", "estimate"};
+constexpr std::array<const char *, 4> input_names = {"odom", "gt_pose", "gt_twist", "imu"};
+#endif
+
+diagnostic_msgs::msg::KeyValue makeKeyValue(const std::string &_key, const double _value)
+{
+  diagnostic_msgs::msg::KeyValue key_value;
+  key_value.key = _key;
+  key_value.value = std::to_string(_value);
+  return key_value;
+}
+
+/**
+ * @brief Publish by reference through rcl, which serializes the message in place. rclcpp copies
+ * messages published by reference when intra-process comms are enabled, with or without
+ * intra-process subscribers.
+ */
+template <typename PublisherT, typename MessageT>
+void publishInterProcess(PublisherT &_publisher, const MessageT &_msg)
+{
+  if (!_publisher.is_activated())
+  {
+    return;
+  }
+  const rcl_publisher_t *handle = _publisher.get_publisher_handle().get();
+  const rcl_ret_t status = rcl_publish(handle, &_msg, nullptr);
+  if (status == RCL_RET_PUBLISHER_INVALID)
+  {
+    rcl_reset_error();
+    const rcl_context_t *context = rcl_publisher_get_context(handle);
+    if (context != nullptr && !rcl_context_is_valid(context))
+    {
+      // Shutting down
+      return;
+    }
+  }
+  if (status != RCL_RET_OK)
+  {
+    rclcpp::exceptions::throw_from_rcl_error(status, "failed to publish message");
+  }
+}
+
+/**
+ * @brief Intra-process subscribers keep the messages they are given as unique_ptrs, so they
+ * get a spare of the reserve, filled in place, and a new copy only when the reserve ran out.
+ * Otherwise the message is loaned from the middleware when it supports it, or the preallocated
+ * one is published by reference. Intra-process subscribers taking shared pointers, or mixed
+ * with inter-process ones, still make rclcpp allocate a shared copy.
+ */
+template <typename PublisherT, typename MessageT, typename FillFunction>
+void publishMessage(PublisherT &_publisher, MessageT &_preallocated_msg,
+                    basic_state_estimator::MessageReserve<MessageT> &_reserve,
+                    const bool _intra_process, FillFunction _fill)
+{
+  if (_intra_process && _publisher.get_intra_process_subscription_count() > 0)
+  {
+    std::unique_ptr<MessageT> msg = _reserve.take();
+    if (!msg)
+    {
+      msg = std::make_unique<MessageT>(_preallocated_msg);
+    }
+    _fill(*msg);
+    _reserve.updatePrototype(*msg);
+    _publisher.publish(std::move(msg));
+    return;
+  }
+  // Loaned messages skip the intra-process path
+  if (_publisher.can_loan_messages())
+  {
+    auto loaned_msg = _publisher.borrow_loaned_message();
+    _fill(loaned_msg.get());
+    _publisher.publish(std::move(loaned_msg));
+    return;
+  }
+  _fill(_preallocated_msg);
+  if (_intra_process)
+  {
+    publishInterProcess(_publisher, _preallocated_msg);
+    return;
+  }
+  _publisher.publish(_preallocated_msg);
+}
+
+// Frame ids are only copied when they change, so the steady state reuses their storage
+void assignFrameId(std::string &_frame_id, const std::string &_source)
+{
+  if (_frame_id != _source)
+  {
+    _frame_id = _source;
+  }
+}
+
+void setColumn(basic_state_estimator::PoseArrays &_arrays, const std::size_t _index,
+               const basic_state_estimator::Pose &_pose)
+{
+  const Eigen::Index i = static_cast<Eigen::Index>(_index);
+  _arrays.x[i] = _pose.position.x();
+  _arrays.y[i] = _pose.position.y();
+  _arrays.z[i] = _pose.position.z();
+  _arrays.qx[i] = _pose.orientation.x();
+  _arrays.qy[i] = _pose.orientation.y();
+  _arrays.qz[i] = _pose.orientation.z();
+  _arrays.qw[i] = _pose.orientation.w();
+}
+
+basic_state_estimator::Pose getColumn(const basic_state_estimator::PoseArrays &_arrays,
+                                      const std::size_t _index)
+{
+  const Eigen::Index i = static_cast<Eigen::Index>(_index);
+  basic_state_estimator::Pose pose;
+  pose.position = Eigen::Vector3d(_arrays.x[i], _arrays.y[i], _arrays.z[i]);
+  pose.orientation = Eigen::Quaterniond(_arrays.qw[i], _arrays.qx[i], _arrays.qy[i], _arrays.qz[i]);
+  return pose;
+}
+} // namespace
+
+// Mode specializations of the pipeline stages, defined below
+template <>
+basic_state_estimator::Pose BasicStateEstimator::localize<basic_state_estimator::OdomOnlyMode>();
+template <>
+basic_state_estimator::Pose BasicStateEstimator::localize<basic_state_estimator::GroundTruthMode>();
+template <>
+basic_state_estimator::Pose
+BasicStateEstimator::localize<basic_state_estimator::SensorFusionMode>();
+template <> void BasicStateEstimator::updateGlobalTwist<basic_state_estimator::OdomOnlyMode>();
+template <> void BasicStateEstimator::updateGlobalTwist<basic_state_estimator::GroundTruthMode>();
+template <> void BasicStateEstimator::updateGlobalTwist<basic_state_estimator::SensorFusionMode>();
+template <> void BasicStateEstimator::updateCovariance<basic_state_estimator::OdomOnlyMode>();
+template <> void BasicStateEstimator::updateCovariance<basic_state_estimator::GroundTruthMode>();
+template <> void BasicStateEstimator::updateCovariance<basic_state_estimator::SensorFusionMode>();
+
+BasicStateEstimator::BasicStateEstimator(const rclcpp::NodeOptions &_options)
+    : as2::Node("basic_state_estimator", _options)
 {
   this->declare_parameter<bool>("odom_only", false);
   this->declare_parameter<bool>("ground_truth", false);
   this->declare_parameter<bool>("sensor_fusion", false);
   this->declare_parameter<std::string>("base_frame", "base_link");
+  this->declare_parameter<std::vector<std::string>>("odom_sources", std::vector<std::string>());
+  this->declare_parameter<std::vector<double>>("odom_source_timeouts", std::vector<double>());
+  this->declare_parameter<double>("odom_source_timeout", 0.5);
+  this->declare_parameter<double>("odom_source_recovery_time", 1.0);
+  this->declare_parameter<bool>("publish_on_input", false);
+  this->declare_parameter<double>("max_publish_rate", 200.0);
+  this->declare_parameter<bool>("publish_only_new_data", false);
+  this->declare_parameter<double>("heartbeat_rate", 0.0);
+  this->declare_parameter<bool>("tf_map2odom_on_change", false);
+  this->declare_parameter<double>("tf_map2odom_keepalive", 1.0);
+  this->declare_parameter<double>("global_ref_refresh_period", 1.0);
+  this->declare_parameter<std::string>("ground_truth_ingestion", "callback");
+  this->declare_parameter<std::string>("ground_truth_content_filter", "");
+  this->declare_parameter<bool>("ground_truth_pair_by_stamp", false);
+  this->declare_parameter<bool>("publish_covariance", false);
+  this->declare_parameter<double>("diagnostics_period", 1.0);
+  // Sensor fusion, standard deviations used when a measurement has no covariance
+  const basic_state_estimator::FusionParameters fusion;
+  this->declare_parameter<double>("fusion.acc_noise", fusion.noise.acc_noise);
+  this->declare_parameter<double>("fusion.gyro_noise", fusion.noise.gyro_noise);
+  this->declare_parameter<double>("fusion.acc_bias_noise", fusion.noise.acc_bias_noise);
+  this->declare_parameter<double>("fusion.gyro_bias_noise", fusion.noise.gyro_bias_noise);
+  this->declare_parameter<double>("fusion.odom_position_std", fusion.odom_position_std);
+  this->declare_parameter<double>("fusion.odom_orientation_std", fusion.odom_orientation_std);
+  this->declare_parameter<double>("fusion.odom_velocity_std", fusion.odom_velocity_std);
+  this->declare_parameter<double>("fusion.pose_position_std", fusion.pose_position_std);
+  this->declare_parameter<double>("fusion.pose_orientation_std", fusion.pose_orientation_std);
+  this->declare_parameter<double>("fusion.imu_timeout", fusion.imu_timeout);
+  this->declare_parameter<int>("fusion.replay_window", static_cast<int>(fusion.replay_window));
+  this->declare_parameter<int>("fusion.max_replay_depth",
+                               static_cast<int>(fusion.max_replay_depth));
+  this->declare_parameter<bool>("imu_propagation.enabled", false);
+  this->declare_parameter<double>("imu_propagation.max_horizon", 0.1);
+  this->declare_parameter<int>("executor_threads", 1);
+  this->declare_parameter<bool>("release_subscriptions_on_deactivate", false);
+  for (const char *topic : qos_names)
+  {
+    const std::string prefix = std::string("qos.") + topic;
+    this->declare_parameter<std::string>(prefix + ".reliability", "default");
+    this->declare_parameter<int>(prefix + ".depth", 0);
+    this->declare_parameter<double>(prefix + ".deadline", 0.0);
+    this->declare_parameter<double>(prefix + ".lifespan", 0.0);
+  }
+  this->declare_parameter<int>("state_history_size", 1000);
+  this->declare_parameter<std::string>("snapshot.path", "");
+  this->declare_parameter<double>("snapshot.period", 0.1);
+  this->declare_parameter<double>("snapshot.max_age", 10.0);
+  this->declare_parameter<bool>("realtime", false);
+  this->declare_parameter<int>("realtime_priority", 80);
+  this->declare_parameter<int>("realtime_cpu", -1);
+  this->declare_parameter<bool>("realtime_lock_memory", true);
+
+  selectPipeline<basic_state_estimator::OdomOnlyMode>();
+  parameters_callback_handle_ = this->add_on_set_parameters_callback(
+      std::bind(&BasicStateEstimator::onParametersSet, this, std::placeholders::_1));
+}
+
+BasicStateEstimator::~BasicStateEstimator() { stopRealtimeLoop(); }
+
+void BasicStateEstimator::run()
+{
+  if (!active_.load(std::memory_order_relaxed))
+  {
+    return;
+  }
+  if (take_ground_truth_)
+  {
+    takeGroundTruth();
+  }
+  if (!start_run_)
+  {
+    return;
+  }
+  // On publish on input mode the timer only flushes the samples merged by the rate limit, once
+  // their publish slot is reached
+  if (publish_on_input_ && (!pending_estimation_ || !publishSlotOpen()))
+  {
+    return;
+  }
+  tryEstimate();
+}
+
+bool BasicStateEstimator::publishSlotOpen() const
+{
+  return std::chrono::steady_clock::now() - last_estimation_time_.load(std::memory_order_relaxed) >=
+         min_publish_period_;
+}
+
+void BasicStateEstimator::armFlush()
+{
+  if (flush_timer_ && !flush_armed_.exchange(true))
+  {
+    flush_timer_->reset();
+  }
+}
+
+void BasicStateEstimator::flushMerged()
+{
+  // One shot, armed again by the next merged sample
+  flush_timer_->cancel();
+  flush_armed_ = false;
+  if (!active_.load(std::memory_order_relaxed) || !pending_estimation_)
+  {
+    return;
+  }
+  if (!publishSlotOpen())
+  {
+    // Another estimate took the slot meanwhile
+    armFlush();
+    return;
+  }
+  tryEstimate();
+}
+
+void BasicStateEstimator::startRunTimer(const double _frequency)
+{
+  run_frequency_ = _frequency;
+  realtime_run_ = false;
+  createRunLoop();
+}
+
+void BasicStateEstimator::startRealtimeLoop(const double _frequency)
+{
+  run_frequency_ = _frequency;
+  realtime_run_ = true;
+  createRunLoop();
+  if (active_)
+  {
+    startRealtimeThread();
+  }
+}
+
+void BasicStateEstimator::createRunLoop()
+{
+  // Remembered across cleanup, every configuration recreates the loop in its callback group
+  if (run_frequency_ <= 0.0)
+  {
+    return;
+  }
+  const std::chrono::duration<double> period(1.0 / run_frequency_);
+  if (!realtime_run_)
+  {
+    run_timer_ = this->create_wall_timer(period, std::bind(&BasicStateEstimator::run, this),
+                                         run_cb_group_);
+    return;
+  }
+  basic_state_estimator::RealtimeOptions &options = realtime_options_;
+  int64_t priority, cpu;
+  this->get_parameter("realtime_priority", priority);
+  this->get_parameter("realtime_cpu", cpu);
+  this->get_parameter("realtime_lock_memory", options.lock_memory);
+  options.priority = static_cast<int>(priority);
+  options.cpu = static_cast<int>(cpu);
+  realtime_loop_ = std::make_unique<basic_state_estimator::RealtimeLoop>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(period),
+      std::bind(&BasicStateEstimator::run, this));
+}
+
+void BasicStateEstimator::startRealtimeThread()
+{
+  const std::string errors = realtime_loop_->start(realtime_options_);
+  RCLCPP_INFO(get_logger(), "REAL-TIME LOOP, PRIORITY: %d, CPU: %d", realtime_options_.priority,
+              realtime_options_.cpu);
+  if (!errors.empty())
+  {
+    RCLCPP_WARN(get_logger(), "REAL-TIME SETTINGS NOT APPLIED: %s", errors.c_str());
+  }
+}
+
+void BasicStateEstimator::startReserveRefill()
+{
+  // Spares start as copies of the preallocated messages, with their frame ids already set
+  pose_reserve_.updatePrototype(pose_msg_);
+  twist_reserve_.updatePrototype(twist_msg_);
+  std::vector<basic_state_estimator::MessageReserveBase *> reserves = {&pose_reserve_,
+                                                                        &twist_reserve_};
+  if (publish_covariance_)
+  {
+    pose_covariance_reserve_.updatePrototype(pose_covariance_msg_);
+    twist_covariance_reserve_.updatePrototype(twist_covariance_msg_);
+    reserves.push_back(&pose_covariance_reserve_);
+    reserves.push_back(&twist_covariance_reserve_);
+  }
+  if (!tf_batch_)
+  {
+    tf_reserve_.updatePrototype(tf_msg_);
+    odom_tf_reserve_.updatePrototype(odom_tf_msg_);
+    reserves.push_back(&tf_reserve_);
+    reserves.push_back(&odom_tf_reserve_);
+  }
+  reserve_refill_.start(reserves);
+}
+
+void BasicStateEstimator::stopRealtimeLoop()
+{
+  if (realtime_loop_)
+  {
+    realtime_loop_->stop();
+  }
+}
+
+void BasicStateEstimator::setTfBatch(
+    const std::shared_ptr<basic_state_estimator::TfBatch> &_tf_batch)
+{
+  tf_batch_ = _tf_batch;
+}
+
+void BasicStateEstimator::tryEstimate()
+{
+  // Callbacks and the run timer may race for the estimation on a multithreaded executor,
+  // the loser leaves its sample pending instead of waiting
+  if (estimation_in_progress_.exchange(true, std::memory_order_acquire))
+  {
+    BSE_COUNT(merged_);
+    pending_estimation_ = true;
+    return;
+  }
+  pending_estimation_ = false;
+  estimate();
+  estimation_in_progress_.store(false, std::memory_order_release);
+}
+
+bool BasicStateEstimator::consumeInputs() { return (this->*pipeline_.consume_inputs)(); }
+
+template <typename ModeT> bool BasicStateEstimator::consumeInputsFor()
+{
+  source_updated_ = false;
+  bool updated = false;
+  if constexpr (ModeT::uses_odometry)
+  {
+    if (odom_sources_.size() > 1)
+    {
+      arbitrateOdometry<ModeT>();
+    }
+    // Samples the previous source wrote before a failover are dropped
+    if (odom_buffer_.update() &&
+        odom_buffer_.read().source == active_odom_source_.load(std::memory_order_relaxed))
+    {
+      const OdomSample &odom = odom_buffer_.read();
+      odom_source_ = odom.source;
+      odom_stamp_ = odom.stamp;
+      odom2baselink_ = odom.pose;
+      odom_linear_velocity_ = odom.linear_velocity;
+      odom_angular_velocity_ = odom.angular_velocity;
+      if (publish_covariance_)
+      {
+        odom_pose_covariance_ = odom.pose_covariance;
+        odom_twist_covariance_ = odom.twist_covariance;
+      }
+      source_updated_ = true;
+    }
+  }
+  if constexpr (ModeT::uses_ground_truth)
+  {
+    if (gt_twist_buffer_.update())
+    {
+      const geometry_msgs::msg::TwistStamped &gt_twist = gt_twist_buffer_.read();
+      assignFrameId(gt_twist_frame_, gt_twist.header.frame_id);
+      if (pair_ground_truth_)
+      {
+        // Applied with the pose of the same stamp
+        basic_state_estimator::StateSample sample;
+        sample.stamp = rclcpp::Time(gt_twist.header.stamp).nanoseconds();
+        sample.linear_velocity = basic_state_estimator::fromMsg(gt_twist.twist.linear);
+        sample.angular_velocity = basic_state_estimator::fromMsg(gt_twist.twist.angular);
+        gt_twist_history_.push(sample);
+      }
+      else
+      {
+        gt_linear_velocity_ = basic_state_estimator::fromMsg(gt_twist.twist.linear);
+        gt_angular_velocity_ = basic_state_estimator::fromMsg(gt_twist.twist.angular);
+        updated = true;
+      }
+    }
+    if (gt_pose_buffer_.update())
+    {
+      // A newer pose replacing a waiting one keeps its wait
+      gt_pose_waited_ = gt_pose_pending_ && gt_pose_waited_;
+      gt_pose_pending_ = true;
+    }
+    if (gt_pose_pending_ && pairGroundTruth())
+    {
+      gt_pose_ = basic_state_estimator::fromMsg(gt_pose_buffer_.read().pose);
+      gt_pose_stamp_ = gt_pose_buffer_.read().header.stamp;
+      gt_pose_pending_ = false;
+      source_updated_ = true;
+    }
+  }
+  if constexpr (ModeT::uses_fusion)
+  {
+    if (fusion_buffer_.update())
+    {
+      fusion_state_ = fusion_buffer_.read();
+      source_updated_ = true;
+    }
+  }
+  return updated || source_updated_;
+}
+
+template <typename ModeT> void BasicStateEstimator::arbitrateOdometry()
+{
+  const std::size_t active = active_odom_source_.load(std::memory_order_relaxed);
+  const std::chrono::steady_clock::rep now =
+      std::chrono::steady_clock::now().time_since_epoch().count();
+  std::size_t next = active;
+  const uint32_t recovered = recovered_odom_sources_.exchange(0, std::memory_order_acquire);
+  if (recovered != 0)
+  {
+    // Highest priority source delivering again for the recovery time
+    next = std::min(active, static_cast<std::size_t>(__builtin_ctz(recovered)));
+  }
+  else if (isOdomSourceStale(active, now))
+  {
+    // Only scanned while the active source is stalled, the steady state is a single check.
+    // Higher priority sources still recovering are skipped, unless nothing else delivers.
+    for (std::size_t i = 0; i < odom_sources_.size(); i++)
+    {
+      if (i != active && !isOdomSourceStale(i, now) &&
+          (i > active || isOdomSourceRecovered(i, now)))
+      {
+        next = i;
+        break;
+      }
+    }
+    for (std::size_t i = 0; next == active && i < odom_sources_.size(); i++)
+    {
+      if (i != active && !isOdomSourceStale(i, now))
+      {
+        next = i;
+        break;
+      }
+    }
+  }
+  if (next == active)
+  {
+    return;
+  }
+  active_odom_source_.store(next, std::memory_order_release);
+  odom_failovers_++;
+  if constexpr (ModeT::offset_on_switch)
+  {
+    // The first sample of the new source is offset to continue from the last estimated pose
+    core_.beginHandover();
+  }
+  RCLCPP_WARN(get_logger(), "ODOMETRY SOURCE: %s -> %s", odom_sources_[active].topic.c_str(),
+              odom_sources_[next].topic.c_str());
+}
+
+bool BasicStateEstimator::isOdomSourceStale(const std::size_t _source,
+                                            const std::chrono::steady_clock::rep _now) const
+{
+  const std::chrono::steady_clock::rep last_receipt =
+      odom_sources_[_source].last_receipt.load(std::memory_order_relaxed);
+  return last_receipt == 0 || _now - last_receipt > odom_sources_[_source].timeout;
+}
+
+bool BasicStateEstimator::isOdomSourceRecovered(const std::size_t _source,
+                                                const std::chrono::steady_clock::rep _now) const
+{
+  return _now - odom_sources_[_source].healthy_since.load(std::memory_order_relaxed) >=
+         odom_source_recovery_;
+}
+
+bool BasicStateEstimator::pairGroundTruth()
+{
+  if (!pair_ground_truth_ || gt_twist_history_.size() == 0)
+  {
+    return true;
+  }
+  const int64_t stamp = rclcpp::Time(gt_pose_buffer_.read().header.stamp).nanoseconds();
+  // The twist of this stamp has not arrived yet, the pose waits for it at most one cycle
+  if (stamp > gt_twist_history_.newest().stamp && !gt_pose_waited_)
+  {
+    gt_pose_waited_ = true;
+    return false;
+  }
+  basic_state_estimator::StateSample twist;
+  if (!gt_twist_history_.lookup(stamp, twist))
+  {
+    // Out of the twist history, the closest end is used
+    twist = stamp > gt_twist_history_.newest().stamp ? gt_twist_history_.newest()
+                                                      : gt_twist_history_.oldest();
+  }
+  gt_linear_velocity_ = twist.linear_velocity;
+  gt_angular_velocity_ = twist.angular_velocity;
+  return true;
+}
+
+bool BasicStateEstimator::skipCycle(const bool _new_data) const
+{
+  if (!publish_only_new_data_ || _new_data)
+  {
+    return false;
+  }
+  // Republish the last estimate, with its stamp, once per heartbeat period
+  return heartbeat_period_ == std::chrono::steady_clock::duration::zero() ||
+         std::chrono::steady_clock::now() - last_estimation_time_.load(std::memory_order_relaxed) <
+             heartbeat_period_;
+}
+
+void BasicStateEstimator::estimate()
+{
+  applyModeSwitch();
+  (this->*pipeline_.estimate)();
+}
+
+bool BasicStateEstimator::gatherBatch(basic_state_estimator::SwarmKernel &_kernel,
+                                      const std::size_t _index)
+{
+  if (!active_.load(std::memory_order_relaxed))
+  {
+    return false;
+  }
+  if (take_ground_truth_)
+  {
+    takeGroundTruth();
+  }
+  if (!start_run_ || estimation_in_progress_.exchange(true, std::memory_order_acquire))
+  {
+    return false;
+  }
+  applyModeSwitch();
+  if (sensor_fusion_ || publish_on_input_ || !global2map_owned_)
+  {
+    estimation_in_progress_.store(false, std::memory_order_release);
+    return false;
+  }
+  if (skipCycle(consumeInputs()))
+  {
+    // Left to run(), which also skips it
+    estimation_in_progress_.store(false, std::memory_order_release);
+    return false;
+  }
+  const basic_state_estimator::Pose map2baselink = calculateLocalization();
+  if (estimation_stamp_.nanoseconds() == 0)
+  {
+    // Source without stamp
+    estimation_stamp_ = this->get_clock()->now();
+  }
+  setColumn(_kernel.odom2baselink, _index, odom2baselink_);
+  setColumn(_kernel.map2baselink, _index, map2baselink);
+  setColumn(_kernel.global2map, _index, core_.global2map());
+  const Eigen::Index i = static_cast<Eigen::Index>(_index);
+  _kernel.body_velocity.x[i] = odom_linear_velocity_.x();
+  _kernel.body_velocity.y[i] = odom_linear_velocity_.y();
+  _kernel.body_velocity.z[i] = odom_linear_velocity_.z();
+  return true;
+}
+
+void BasicStateEstimator::scatterBatch(const basic_state_estimator::SwarmKernel &_kernel,
+                                       const std::size_t _index)
+{
+  // Same outputs as updateOdomTfDrift() and getGlobalRefState() for an owned chain
+  map2odom_ = getColumn(_kernel.map2odom, _index);
+  publishTfs();
+
+  global2baselink_ = getColumn(_kernel.global2baselink, _index);
+  if (pipeline_.mode == basic_state_estimator::OdomOnlyMode::index)
+  {
+    const Eigen::Index i = static_cast<Eigen::Index>(_index);
+    assignFrameId(global_twist_frame_, global_ref_frame_);
+    global_angular_velocity_ = odom_angular_velocity_;
+    global_linear_velocity_ = Eigen::Vector3d(
+        _kernel.global_velocity.x[i], _kernel.global_velocity.y[i], _kernel.global_velocity.z[i]);
+  }
+  else
+  {
+    (this->*pipeline_.global_twist)();
+  }
+  if (publish_covariance_)
+  {
+    (this->*pipeline_.covariance)();
+  }
+
+  recordState();
+  publishStateEstimation();
+  saveSnapshot();
+  last_estimation_time_.store(std::chrono::steady_clock::now(), std::memory_order_relaxed);
+  estimation_in_progress_.store(false, std::memory_order_release);
+}
+
+rcl_interfaces::msg::SetParametersResult
+BasicStateEstimator::onParametersSet(const std::vector<rclcpp::Parameter> &_parameters)
+{
+  rcl_interfaces::msg::SetParametersResult result;
+  result.successful = true;
+  // Mode flags after this change, the last enabled source wins as in activeMode()
+  std::array<bool, mode_names.size()> flags;
+  for (std::size_t mode = 0; mode < flags.size(); mode++)
+  {
+    flags[mode] = this->get_parameter(mode_names[mode]).as_bool();
+  }
+  bool mode_changed = false;
+  for (const rclcpp::Parameter &parameter : _parameters)
+  {
+    for (std::size_t mode = 0; mode < flags.size(); mode++)
+    {
+      if (parameter.get_name() == mode_names[mode])
+      {
+        flags[mode] = parameter.as_bool();
+        mode_changed = true;
+      }
+    }
+  }
+  if (!mode_changed)
+  {
+    return result;
+  }
+  if (!flags[0] && !flags[1] && !flags[2])
+  {
+    result.successful = false;
+    result.reason = "At least one estimation mode must stay enabled";
+    return result;
+  }
+  // Applied by the estimation at its next cycle, this never waits on it
+  requested_mode_.store(flags[2] ? 2 : (flags[1] ? 1 : 0), std::memory_order_release);
+  return result;
+}
+
+void BasicStateEstimator::applyModeSwitch()
+{
+  const int mode = requested_mode_.exchange(-1, std::memory_order_acquire);
+  if (mode < 0 || static_cast<std::size_t>(mode) == activeMode())
+  {
+    return;
+  }
+  RCLCPP_INFO(get_logger(), "SWITCHING TO %s MODE", mode_names[mode]);
+  odom_only_ = mode == 0;
+  ground_truth_ = mode == 1;
+  sensor_fusion_ = mode == 2;
+  selectPipeline();
+
+  // The new source is offset to continue from the last estimated pose, keeping the drift
+  core_.beginHandover();
+  if (sensor_fusion_)
+  {
+    setupSensorFusion();
+    if (core_.hasMap2Baselink())
+    {
+      // The filter starts at the last estimated state instead of at its first measurement
+      const Eigen::Vector3d map_velocity =
+          core_.global2map().orientation.conjugate() * global_linear_velocity_;
+      const basic_state_estimator::Pose &map2baselink = core_.lastMap2Baselink();
+      std::lock_guard<std::mutex> lock(fusion_mutex_);
+      fusion_filter_.initialize(estimation_stamp_.nanoseconds(), map2baselink.position,
+                                map2baselink.orientation, map_velocity);
+      publishFusionState();
+    }
+  }
+}
+
+void BasicStateEstimator::onInputReceived()
+{
+  start_run_ = true;
+  if (!publish_on_input_)
+  {
+    return;
+  }
+  // Merge bursts: samples arriving faster than max_publish_rate wait for the next slot
+  if (!publishSlotOpen())
+  {
+    BSE_COUNT(merged_);
+    pending_estimation_ = true;
+    armFlush();
+    return;
+  }
+  tryEstimate();
+}
+
+void BasicStateEstimator::setupNode()
+{
+  // Initialize the transform publishers, /tf uses the same topic and QoS as a broadcaster
+  if (!tf_batch_)
+  {
+    tf_pub_ =
+        this->create_publisher<tf2_msgs::msg::TFMessage>("/tf", tf2_ros::DynamicBroadcasterQoS());
+    tfstatic_broadcaster_ = std::make_shared<tf2_ros::StaticTransformBroadcaster>(this);
+  }
+  // The tf listener is only created if the global reference is not owned by this node
+
+  // Each input gets its own group so a multithreaded executor can serve them in parallel
+  odom_cb_group_ = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+  imu_cb_group_ = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+  run_cb_group_ = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+
+  std::vector<std::string> odom_topics;
+  std::vector<double> odom_timeouts;
+  double odom_timeout, odom_recovery_time;
+  this->get_parameter("odom_sources", odom_topics);
+  this->get_parameter("odom_source_timeouts", odom_timeouts);
+  this->get_parameter("odom_source_timeout", odom_timeout);
+  this->get_parameter("odom_source_recovery_time", odom_recovery_time);
+  odom_source_recovery_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                              std::chrono::duration<double>(std::max(odom_recovery_time, 0.0)))
+                              .count();
+  if (odom_topics.empty())
+  {
+    odom_topics.emplace_back(as2_names::topics::sensor_measurements::odom);
+  }
+  if (odom_topics.size() > max_odom_sources)
+  {
+    RCLCPP_WARN(get_logger(), "TOO MANY ODOMETRY SOURCES, USING THE FIRST %zu", max_odom_sources);
+    odom_topics.resize(max_odom_sources);
+  }
+  // Sources hold their atomics in place, so the vector is built once at its final size
+  odom_sources_ = std::vector<OdomSource>(odom_topics.size());
+  for (std::size_t i = 0; i < odom_sources_.size(); i++)
+  {
+    OdomSource &source = odom_sources_[i];
+    source.topic = this->generate_global_name(odom_topics[i]);
+    source.timeout = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                         std::chrono::duration<double>(
+                             i < odom_timeouts.size() ? odom_timeouts[i] : odom_timeout))
+                         .count();
+    if (odom_sources_.size() > 1)
+    {
+      RCLCPP_INFO(get_logger(), "ODOMETRY SOURCE %zu: %s, TIMEOUT: %.3f s", i,
+                  source.topic.c_str(), source.timeout * 1e-9);
+    }
+  }
+
+  // Ground truth may come faster than the estimation (mocap). keep_last only queues its newest
+  // sample, and take leaves the subscriptions out of the executor: run() takes their newest
+  // sample, so they never wake the executor.
+  std::string ground_truth_ingestion;
+  this->get_parameter("ground_truth_ingestion", ground_truth_ingestion);
+  this->get_parameter("ground_truth_content_filter", ground_truth_content_filter_);
+  if (ground_truth_ingestion != "callback" && ground_truth_ingestion != "keep_last" &&
+      ground_truth_ingestion != "take")
+  {
+    RCLCPP_WARN(get_logger(), "UNKNOWN GROUND TRUTH INGESTION %s, USING callback",
+                ground_truth_ingestion.c_str());
+    ground_truth_ingestion = "callback";
+  }
+  take_ground_truth_ = ground_truth_ingestion == "take";
+  setupQos();
+  if (ground_truth_ingestion != "callback")
+  {
+    qos_[QOS_GROUND_TRUTH].keep_last(1);
+    RCLCPP_INFO(get_logger(), "GROUND TRUTH INGESTION: %s", ground_truth_ingestion.c_str());
+  }
+  ground_truth_cb_group_ = this->create_callback_group(
+      rclcpp::CallbackGroupType::MutuallyExclusive, !take_ground_truth_);
+  this->get_parameter("release_subscriptions_on_deactivate", release_subscriptions_);
+  createSubscriptions();
+
+  intra_process_ = this->get_node_options().use_intra_process_comms();
+  const rclcpp::QoS &output_qos = qos_[QOS_SELF_LOCALIZATION];
+  const rclcpp::PublisherOptions output_options =
+      qosOptions<rclcpp::PublisherOptions>(QOS_SELF_LOCALIZATION);
+  pose_estimated_pub_ = this->create_publisher<geometry_msgs::msg::PoseStamped>(
+      as2_names::topics::self_localization::pose, output_qos, output_options);
+  twist_estimated_pub_ = this->create_publisher<geometry_msgs::msg::TwistStamped>(
+      as2_names::topics::self_localization::twist, output_qos, output_options);
+  this->get_parameter("publish_covariance", publish_covariance_);
+  if (publish_covariance_)
+  {
+    pose_covariance_pub_ = this->create_publisher<geometry_msgs::msg::PoseWithCovarianceStamped>(
+        "self_localization/pose_with_covariance", output_qos, output_options);
+    twist_covariance_pub_ =
+        this->create_publisher<geometry_msgs::msg::TwistWithCovarianceStamped>(
+            "self_localization/twist_with_covariance", output_qos, output_options);
+  }
+
+  double diagnostics_period;
+  this->get_parameter("diagnostics_period", diagnostics_period);
+  diagnostics_pub_ =
+      this->create_publisher<diagnostic_msgs::msg::DiagnosticArray>("/diagnostics", 10);
+  if (diagnostics_period > 0.0)
+  {
+    diagnostics_timer_ =
+        this->create_wall_timer(std::chrono::duration<double>(diagnostics_period),
+                                std::bind(&BasicStateEstimator::publishDiagnostics, this),
+                                run_cb_group_);
+  }
+
+  int state_history_size;
+  this->get_parameter("state_history_size", state_history_size);
+  state_history_ = basic_state_estimator::StateHistory(std::max(state_history_size, 2));
+  service_cb_group_ = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+  get_state_srv_ = this->create_service<basic_state_estimator::srv::GetStateAtTime>(
+      "self_localization/get_state_at_time",
+      std::bind(&BasicStateEstimator::getStateAtTimeCallback, this, std::placeholders::_1,
+                std::placeholders::_2),
+      rclcpp::ServicesQoS(), service_cb_group_);
+  createRunLoop();
+
+  std::string snapshot_path;
+  double snapshot_period;
+  this->get_parameter("snapshot.path", snapshot_path);
+  this->get_parameter("snapshot.period", snapshot_period);
+  snapshot_period_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(std::max(snapshot_period, 0.0)));
+  snapshot_.close();
+  if (!snapshot_path.empty())
+  {
+    const std::string error = snapshot_.open(snapshot_path);
+    if (!error.empty())
+    {
+      RCLCPP_WARN(get_logger(), "STATE SNAPSHOT DISABLED: %s", error.c_str());
+    }
+  }
+}
+
+void BasicStateEstimator::setupQos()
+{
+  qos_.clear();
+  for (std::size_t topic = 0; topic < QOS_COUNT; topic++)
+  {
+    const std::string prefix = std::string("qos.") + qos_names[topic];
+    std::string reliability;
+    int64_t depth;
+    double deadline, lifespan;
+    this->get_parameter(prefix + ".reliability", reliability);
+    this->get_parameter(prefix + ".depth", depth);
+    this->get_parameter(prefix + ".deadline", deadline);
+    this->get_parameter(prefix + ".lifespan", lifespan);
+
+    qos_.emplace_back(topic == QOS_SELF_LOCALIZATION
+                          ? as2_names::topics::self_localization::qos
+                          : as2_names::topics::sensor_measurements::qos);
+    rclcpp::QoS &qos = qos_.back();
+    if (reliability == "reliable")
+    {
+      qos.reliable();
+    }
+    else if (reliability == "best_effort")
+    {
+      qos.best_effort();
+    }
+    else if (reliability != "default")
+    {
+      RCLCPP_WARN(get_logger(), "UNKNOWN %s.reliability %s, USING default", prefix.c_str(),
+                  reliability.c_str());
+    }
+    if (depth > 0)
+    {
+      qos.keep_last(static_cast<std::size_t>(depth));
+    }
+    qos_deadline_[topic] = deadline > 0.0;
+    if (qos_deadline_[topic])
+    {
+      qos.deadline(rclcpp::Duration::from_seconds(deadline));
+    }
+    if (lifespan > 0.0)
+    {
+      qos.lifespan(rclcpp::Duration::from_seconds(lifespan));
+    }
+    deadlines_missed_[topic] = 0;
+  }
+}
+
+template <typename OptionsT> OptionsT BasicStateEstimator::qosOptions(const QosTopic _topic)
+{
+  OptionsT options;
+  // Only requested with a deadline, not every middleware supports the event
+  if (qos_deadline_[_topic])
+  {
+    options.event_callbacks.deadline_callback = [this, _topic](auto &_event) {
+      deadlines_missed_[_topic].fetch_add(static_cast<uint64_t>(_event.total_count_change),
+                                          std::memory_order_relaxed);
+    };
+  }
+  return options;
+}
+
+void BasicStateEstimator::createSubscriptions()
+{
+  rclcpp::SubscriptionOptions odom_options = qosOptions<rclcpp::SubscriptionOptions>(QOS_ODOM);
+  odom_options.callback_group = odom_cb_group_;
+  for (std::size_t i = 0; i < odom_sources_.size(); i++)
+  {
+    odom_sources_[i].subscription = this->create_subscription<nav_msgs::msg::Odometry>(
+        odom_sources_[i].topic, qos_[QOS_ODOM],
+        [this, i](const nav_msgs::msg::Odometry::SharedPtr _msg) { odomCallback(_msg, i); },
+        odom_options);
+  }
+
+  rclcpp::SubscriptionOptions ground_truth_options =
+      qosOptions<rclcpp::SubscriptionOptions>(QOS_GROUND_TRUTH);
+  ground_truth_options.callback_group = ground_truth_cb_group_;
+  // Filtered by the middleware when it supports content filtered topics, e.g.
+  // "header.frame_id = 'drone0'" on a topic shared by every rigid body
+  ground_truth_options.content_filter_options.filter_expression = ground_truth_content_filter_;
+  gt_pose_sub_ = this->create_subscription<geometry_msgs::msg::PoseStamped>(
+      this->generate_global_name(as2_names::topics::ground_truth::pose), qos_[QOS_GROUND_TRUTH],
+      std::bind(&BasicStateEstimator::gtPoseCallback, this, std::placeholders::_1),
+      ground_truth_options);
+
+  gt_twist_sub_ = this->create_subscription<geometry_msgs::msg::TwistStamped>(
+      this->generate_global_name(as2_names::topics::ground_truth::twist), qos_[QOS_GROUND_TRUTH],
+      std::bind(&BasicStateEstimator::gtTwistCallback, this, std::placeholders::_1),
+      ground_truth_options);
+  if (!ground_truth_content_filter_.empty() && !gt_pose_sub_->is_cft_enabled())
+  {
+    RCLCPP_WARN(get_logger(), "CONTENT FILTERED TOPICS NOT SUPPORTED, GROUND TRUTH NOT FILTERED");
+  }
+
+  rclcpp::SubscriptionOptions imu_options = qosOptions<rclcpp::SubscriptionOptions>(QOS_IMU);
+  imu_options.callback_group = imu_cb_group_;
+  imu_sub_ = this->create_subscription<sensor_msgs::msg::Imu>(
+      this->generate_global_name(as2_names::topics::sensor_measurements::imu), qos_[QOS_IMU],
+      std::bind(&BasicStateEstimator::imuCallback, this, std::placeholders::_1), imu_options);
+}
+
+void BasicStateEstimator::releaseSubscriptions()
+{
+  // Destroying the readers also stops their DDS traffic, at the cost of a new discovery on the
+  // next activation
+  for (OdomSource &source : odom_sources_)
+  {
+    source.subscription.reset();
+  }
+  gt_pose_sub_.reset();
+  gt_twist_sub_.reset();
+  imu_sub_.reset();
+}
+
+void BasicStateEstimator::setupTfTree()
+{
+  std::string base_frame;
+  this->get_parameter("base_frame", base_frame);
+  this->get_parameter("odom_only", odom_only_);
+  this->get_parameter("ground_truth", ground_truth_);
+  this->get_parameter("sensor_fusion", sensor_fusion_);
+  this->get_parameter("publish_on_input", publish_on_input_);
+
+  double max_publish_rate;
+  this->get_parameter("max_publish_rate", max_publish_rate);
+  min_publish_period_ = std::chrono::steady_clock::duration::zero();
+  if (max_publish_rate > 0.0)
+  {
+    min_publish_period_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / max_publish_rate));
+  }
+
+  if (publish_on_input_)
+  {
+    RCLCPP_INFO(get_logger(), "PUBLISH ON INPUT, MAX RATE: %.1f Hz", max_publish_rate);
+  }
+  // Merged samples are flushed one slot after they arrive instead of waiting for run(), which
+  // is slower than ceilings above its frequency
+  flush_timer_.reset();
+  flush_armed_ = false;
+  if (publish_on_input_ && min_publish_period_ > std::chrono::steady_clock::duration::zero())
+  {
+    flush_timer_ = this->create_wall_timer(
+        min_publish_period_, std::bind(&BasicStateEstimator::flushMerged, this), run_cb_group_);
+    flush_timer_->cancel();
+  }
+
+  this->get_parameter("publish_only_new_data", publish_only_new_data_);
+  this->get_parameter("ground_truth_pair_by_stamp", pair_ground_truth_);
+  gt_twist_history_.clear();
+  gt_pose_pending_ = false;
+  if (take_ground_truth_ && publish_on_input_)
+  {
+    RCLCPP_WARN(get_logger(), "TAKEN GROUND TRUTH IS ONLY ESTIMATED BY THE LOOP");
+  }
+  double heartbeat_rate;
+  this->get_parameter("heartbeat_rate", heartbeat_rate);
+  heartbeat_period_ = std::chrono::steady_clock::duration::zero();
+  if (heartbeat_rate > 0.0)
+  {
+    heartbeat_period_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / heartbeat_rate));
+  }
+  if (publish_only_new_data_)
+  {
+    RCLCPP_INFO(get_logger(), "PUBLISH ONLY NEW DATA, HEARTBEAT: %.1f Hz", heartbeat_rate);
+  }
+
+  this->get_parameter("tf_map2odom_on_change", tf_map2odom_on_change_);
+  this->get_parameter("tf_map2odom_keepalive", tf_map2odom_keepalive_);
+  double global_ref_refresh_period;
+  this->get_parameter("global_ref_refresh_period", global_ref_refresh_period);
+  global_ref_refresh_period_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(std::max(global_ref_refresh_period, 0.0)));
+
+  if (odom_only_)
+  {
+    RCLCPP_INFO(get_logger(), "ODOM ONLY MODE");
+  }
+
+  if (ground_truth_)
+  {
+    RCLCPP_INFO(get_logger(), "GROUND TRUTH MODE");
+  }
+
+  if (sensor_fusion_)
+  {
+    RCLCPP_INFO(get_logger(), "SENSOR FUSION MODE");
+  }
+
+  if (!odom_only_ & !ground_truth_ & !sensor_fusion_)
+  {
+    RCLCPP_ERROR(get_logger(), "NO ESTIMATION MODE ENABLED");
+    RCLCPP_ERROR(get_logger(), "DEFAULT: ODOM ONLY ACTIVATED");
+    odom_only_ = true;
+  }
+
+  tf2_fix_transforms_.clear();
+  // global reference to drone reference
+  std::string ns = this->get_namespace();
+  {
+    std::lock_guard<std::mutex> lock(state_history_mutex_);
+    global_ref_frame_ = "earth";
+  }
+  map_frame_ = generateTfName(ns, "map");
+  odom_frame_ = generateTfName(ns, "odom");
+  if (base_frame == "")
+  {
+    baselink_frame_ = ns.substr(1, ns.length());
+    RCLCPP_WARN(get_logger(), "NO BASE FRAME SPECIFIED , USING DEFAULT: %s", baselink_frame_.c_str());
+  }
+  else
+  {
+    baselink_frame_ = generateTfName(ns, base_frame);
+  }
+
+  loadSnapshot();
+  getStartingPose(global_ref_frame_, map_frame_);
+
+  basic_state_estimator::Pose global2map;
+  global2map_owned_ = composeFixTransforms(global_ref_frame_, map_frame_, global2map);
+  core_.setGlobal2Map(global2map);
+  global2map_valid_ = global2map_owned_;
+  if (!global2map_owned_ && !tf_listener_)
+  {
+    RCLCPP_WARN(get_logger(), "%s -> %s NOT OWNED, USING TF LISTENER", global_ref_frame_.c_str(),
+                map_frame_.c_str());
+    if (!tf_buffer_)
+    {
+      tf_buffer_ = std::make_shared<tf2_ros::Buffer>(this->get_clock());
+    }
+    tf_listener_ = std::make_shared<tf2_ros::TransformListener>(*tf_buffer_);
+  }
+
+  // init map_2_odom and odom_2_baselink
+  map2odom_ = basic_state_estimator::Pose();
+  odom2baselink_ = basic_state_estimator::Pose();
+  geometry_msgs::msg::TransformStamped map2odom_tf;
+  map2odom_tf.header.frame_id = map_frame_;
+  map2odom_tf.child_frame_id = odom_frame_;
+  map2odom_tf.transform.rotation.w = 1.0;
+  geometry_msgs::msg::TransformStamped odom2baselink_tf;
+  odom2baselink_tf.header.frame_id = odom_frame_;
+  odom2baselink_tf.child_frame_id = baselink_frame_;
+  odom2baselink_tf.transform.rotation.w = 1.0;
+
+  // Every frame id of the outputs is assigned here, the estimation only writes stamps and values
+  tf_msg_.transforms = {map2odom_tf, odom2baselink_tf};
+  odom_tf_msg_.transforms = {odom2baselink_tf};
+  pose_msg_.header.frame_id = global_ref_frame_;
+  twist_msg_.header.frame_id = global_ref_frame_;
+  global_twist_frame_ = global_ref_frame_;
+  last_sent_map2odom_time_ = rclcpp::Time(0, 0, this->get_clock()->get_clock_type());
+  last_sent_tf_stamp_ = rclcpp::Time(0, 0, this->get_clock()->get_clock_type());
+  estimation_stamp_ = rclcpp::Time(0, 0, this->get_clock()->get_clock_type());
+  for (basic_state_estimator::LatencyStatistics &latency_stats : latency_stats_)
+  {
+    latency_stats.reset();
+  }
+
+  RCLCPP_INFO(get_logger(), "%s -> %s", global_ref_frame_.c_str(), map_frame_.c_str());
+  RCLCPP_INFO(get_logger(), "%s -> %s", map2odom_tf.header.frame_id.c_str(),
+              map2odom_tf.child_frame_id.c_str());
+  RCLCPP_INFO(get_logger(), "%s -> %s", odom2baselink_tf.header.frame_id.c_str(),
+              odom2baselink_tf.child_frame_id.c_str());
+
+  publishStaticTfs();
+
+  {
+    std::lock_guard<std::mutex> lock(state_history_mutex_);
+    state_history_.clear();
+    state_history_frames_.clear();
+  }
+
+  requested_mode_ = -1;
+  core_.reset();
+  active_odom_source_ = 0;
+  recovered_odom_sources_ = 0;
+  odom_source_ = 0;
+  odom_failovers_ = 0;
+
+  bool imu_propagation;
+  double imu_propagation_horizon;
+  this->get_parameter("imu_propagation.enabled", imu_propagation);
+  this->get_parameter("imu_propagation.max_horizon", imu_propagation_horizon);
+  {
+    std::lock_guard<std::mutex> lock(propagation_mutex_);
+    imu_propagator_.setMaxHorizon(static_cast<int64_t>(imu_propagation_horizon * 1e9));
+  }
+  imu_propagation_ = imu_propagation;
+  if (imu_propagation)
+  {
+    RCLCPP_INFO(get_logger(), "IMU PROPAGATION, MAX HORIZON: %.3f s", imu_propagation_horizon);
+  }
+  selectPipeline();
+
+  start_run_ = false;
+  pending_estimation_ = false;
+  last_estimation_time_ = std::chrono::steady_clock::time_point();
+
+  if (sensor_fusion_)
+  {
+    setupSensorFusion();
+  }
+  if (snapshot_loaded_)
+  {
+    restoreSnapshot();
+  }
+
+  // // init Tf tree
+  // publishTfs();
+}
+
+void BasicStateEstimator::getStartingPose(const std::string &_global_frame,
+                                          const std::string &_map)
+{
+  if (snapshot_loaded_)
+  {
+    // Starting pose of the run the snapshot comes from
+    geometry_msgs::msg::TransformStamped global2map;
+    global2map.header.frame_id = _global_frame;
+    global2map.child_frame_id = _map;
+    basic_state_estimator::toMsg(basic_state_estimator::fromSnapshot(snapshot_state_.global2map),
+                                 global2map.transform);
+    tf2_fix_transforms_.emplace_back(global2map);
+    return;
+  }
+
+  // Default
+  tf2_fix_transforms_.emplace_back(getTransformation(_global_frame, _map, 0, 0, 0, 0, 0, 0));
+}
+
+void BasicStateEstimator::updateOdomTfDrift(const basic_state_estimator::Pose &_odom2baselink,
+                                            const basic_state_estimator::Pose &_map2baselink)
+{
+  map2odom_ = basic_state_estimator::driftBetween(_odom2baselink, _map2baselink);
+}
+
+basic_state_estimator::Pose BasicStateEstimator::calculateLocalization()
+{
+  return (this->*pipeline_.localize)();
+}
+
+template <>
+basic_state_estimator::Pose BasicStateEstimator::localize<basic_state_estimator::OdomOnlyMode>()
+{
+  estimation_stamp_ = odom_stamp_;
+  return core_.localize<basic_state_estimator::OdomOnlyMode>(odom2baselink_, source_updated_);
+}
+
+template <>
+basic_state_estimator::Pose
+BasicStateEstimator::localize<basic_state_estimator::GroundTruthMode>()
+{
+  // Ground truth is sent as odom -> base_link
+  odom2baselink_ = gt_pose_;
+  estimation_stamp_ = gt_pose_stamp_;
+  return core_.localize<basic_state_estimator::GroundTruthMode>(gt_pose_, source_updated_);
+}
+
+template <>
+basic_state_estimator::Pose
+BasicStateEstimator::localize<basic_state_estimator::SensorFusionMode>()
+{
+  basic_state_estimator::Pose map2baselink;
+  map2baselink.position = fusion_state_.position;
+  map2baselink.orientation = fusion_state_.orientation;
+  estimation_stamp_ = fusion_state_.stamp;
+  return core_.localize<basic_state_estimator::SensorFusionMode>(map2baselink, source_updated_);
+}
+
+bool BasicStateEstimator::composeFixTransforms(const std::string &_parent_frame,
+                                               const std::string &_child_frame,
+                                               basic_state_estimator::Pose &_parent2child)
+{
+  // Walk the fixed transforms back from the child frame up to the parent frame
+  _parent2child = basic_state_estimator::Pose();
+  const std::string *frame = &_child_frame;
+  for (std::size_t depth = 0; depth < tf2_fix_transforms_.size() && *frame != _parent_frame;
+       depth++)
+  {
+    const geometry_msgs::msg::TransformStamped *parent_transform = nullptr;
+    for (const geometry_msgs::msg::TransformStamped &transform : tf2_fix_transforms_)
+    {
+      if (transform.child_frame_id == *frame)
+      {
+        parent_transform = &transform;
+        break;
+      }
+    }
+    if (parent_transform == nullptr)
+    {
+      return false;
+    }
+    _parent2child = basic_state_estimator::compose(
+        basic_state_estimator::fromMsg(parent_transform->transform), _parent2child);
+    frame = &parent_transform->header.frame_id;
+  }
+  return *frame == _parent_frame;
+}
+
+void BasicStateEstimator::getGlobalRefState()
+{
+  updateGlobalPose();
+  (this->*pipeline_.global_twist)();
+}
+
+void BasicStateEstimator::updateGlobalPose()
+{
+  if (!global2map_owned_ && !lookupGlobal2Map())
+  {
+    return;
+  }
+  // The rest of the chain is owned by this node, compose it in memory
+  global2baselink_ = core_.globalPose(map2odom_, odom2baselink_);
+}
+
+bool BasicStateEstimator::lookupGlobal2Map()
+{
+  // A tf lookup returns a new TransformStamped, so it is only done every refresh period
+  const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (global2map_valid_ && now - last_global2map_lookup_ < global_ref_refresh_period_)
+  {
+    return true;
+  }
+  try
+  {
+    const geometry_msgs::msg::TransformStamped global2map =
+        tf_buffer_->lookupTransform(global_ref_frame_, map_frame_, tf2::TimePointZero);
+    core_.setGlobal2Map(basic_state_estimator::fromMsg(global2map.transform));
+    global2map_valid_ = true;
+    last_global2map_lookup_ = now;
+  }
+  catch (tf2::TransformException &ex)
+  {
+    BSE_COUNT(tf_lookup_failures_);
+    RCLCPP_WARN(this->get_logger(), "Transform Failure: %s\n",
+                ex.what()); // Print exception which was caught
+  }
+  return global2map_valid_;
+}
+
+template <> void BasicStateEstimator::updateGlobalTwist<basic_state_estimator::OdomOnlyMode>()
+{
+  assignFrameId(global_twist_frame_, global_ref_frame_);
+  global_angular_velocity_ = odom_angular_velocity_;
+  global_linear_velocity_ = core_.globalVelocity<basic_state_estimator::OdomOnlyMode>(
+      global2baselink_, odom_linear_velocity_);
+}
+
+template <> void BasicStateEstimator::updateGlobalTwist<basic_state_estimator::GroundTruthMode>()
+{
+  assignFrameId(global_twist_frame_, gt_twist_frame_);
+  global_linear_velocity_ = core_.globalVelocity<basic_state_estimator::GroundTruthMode>(
+      global2baselink_, gt_linear_velocity_);
+  global_angular_velocity_ = gt_angular_velocity_;
+}
+
+template <> void BasicStateEstimator::updateGlobalTwist<basic_state_estimator::SensorFusionMode>()
+{
+  // Angular velocity stays in the body frame
+  assignFrameId(global_twist_frame_, global_ref_frame_);
+  global_linear_velocity_ = core_.globalVelocity<basic_state_estimator::SensorFusionMode>(
+      global2baselink_, fusion_state_.velocity);
+  global_angular_velocity_ =
+      fusion_state_.imu_active ? fusion_state_.angular_velocity : odom_angular_velocity_;
+}
+
+template <> void BasicStateEstimator::updateCovariance<basic_state_estimator::OdomOnlyMode>()
+{
+  // Odometry pose covariance is in the odom frame and its twist covariance in the body frame,
+  // the linear twist is published in the global reference frame
+  const Eigen::Matrix3d global2odom =
+      (core_.global2map().orientation * map2odom_.orientation).toRotationMatrix();
+  pose_covariance_ =
+      basic_state_estimator::rotateCovariance(odom_pose_covariance_, global2odom, global2odom);
+  twist_covariance_ = basic_state_estimator::rotateCovariance(
+      odom_twist_covariance_, global2baselink_.orientation.toRotationMatrix(),
+      Eigen::Matrix3d::Identity());
+}
+
+template <> void BasicStateEstimator::updateCovariance<basic_state_estimator::GroundTruthMode>()
+{
+  // Ground truth comes without covariance
+  pose_covariance_.setZero();
+  twist_covariance_.setZero();
+}
+
+template <> void BasicStateEstimator::updateCovariance<basic_state_estimator::SensorFusionMode>()
+{
+  const Eigen::Matrix3d global2map = core_.global2map().orientation.toRotationMatrix();
+  pose_covariance_ = basic_state_estimator::rotateCovariance(fusion_state_.pose_covariance,
+                                                             global2map, global2map);
+  twist_covariance_ = basic_state_estimator::rotateCovariance(
+      fusion_state_.twist_covariance, global2map, Eigen::Matrix3d::Identity());
+  if (!fusion_state_.imu_active)
+  {
+    // Angular velocity from the odometry, see updateGlobalTwist()
+    twist_covariance_.block<3, 3>(0, 3).setZero();
+    twist_covariance_.block<3, 3>(3, 0).setZero();
+    twist_covariance_.block<3, 3>(3, 3) = odom_twist_covariance_.block<3, 3>(3, 3);
+  }
+}
+
+// PIPELINE //
+
+template <typename ModeT> void BasicStateEstimator::estimatePipeline()
+{
+  BSE_SCOPED_TIMER(stage_stats_[STAGE_ESTIMATE]);
+  bool new_data;
+  {
+    BSE_SCOPED_TIMER(stage_stats_[STAGE_CONSUME]);
+    new_data = consumeInputsFor<ModeT>();
+  }
+  if (skipCycle(new_data))
+  {
+    BSE_COUNT(skipped_);
+    return;
+  }
+  basic_state_estimator::Pose map2baselink;
+  {
+    BSE_SCOPED_TIMER(stage_stats_[STAGE_LOCALIZE]);
+    map2baselink = localize<ModeT>();
+  }
+  if (estimation_stamp_.nanoseconds() == 0)
+  {
+    // Source without stamp
+    estimation_stamp_ = this->get_clock()->now();
+  }
+  {
+    BSE_SCOPED_TIMER(stage_stats_[STAGE_DRIFT]);
+    updateOdomTfDrift(odom2baselink_, map2baselink);
+  }
+  {
+    BSE_SCOPED_TIMER(stage_stats_[STAGE_PUBLISH_TFS]);
+    publishTfs();
+  }
+  {
+    BSE_SCOPED_TIMER(stage_stats_[STAGE_GLOBAL_STATE]);
+    updateGlobalPose();
+    updateGlobalTwist<ModeT>();
+    if (publish_covariance_)
+    {
+      updateCovariance<ModeT>();
+    }
+  }
+  {
+    BSE_SCOPED_TIMER(stage_stats_[STAGE_RECORD]);
+    recordState();
+  }
+  {
+    BSE_SCOPED_TIMER(stage_stats_[STAGE_PUBLISH]);
+    publishStateEstimation(new_data);
+  }
+  if constexpr (ModeT::uses_odometry)
+  {
+    // Age of the odometry sample when its estimate is published
+    BSE_RECORD(odom_age_,
+               (this->get_clock()->now() -
+                rclcpp::Time(odom_stamp_, this->get_clock()->get_clock_type()))
+                   .nanoseconds());
+  }
+  saveSnapshot();
+  last_estimation_time_.store(std::chrono::steady_clock::now(), std::memory_order_relaxed);
+}
+
+template <typename ModeT> void BasicStateEstimator::selectPipeline()
+{
+  pipeline_.estimate = &BasicStateEstimator::estimatePipeline<ModeT>;
+  pipeline_.consume_inputs = &BasicStateEstimator::consumeInputsFor<ModeT>;
+  pipeline_.localize = &BasicStateEstimator::localize<ModeT>;
+  pipeline_.global_twist = &BasicStateEstimator::updateGlobalTwist<ModeT>;
+  pipeline_.covariance = &BasicStateEstimator::updateCovariance<ModeT>;
+  pipeline_.mode = ModeT::index;
+  odom_only_ = std::is_same<ModeT, basic_state_estimator::OdomOnlyMode>::value;
+  ground_truth_ = std::is_same<ModeT, basic_state_estimator::GroundTruthMode>::value;
+  sensor_fusion_ = std::is_same<ModeT, basic_state_estimator::SensorFusionMode>::value;
+  fuse_inputs_ = ModeT::uses_fusion;
+  {
+    // Anchors from a previous odom only run are stale
+    std::lock_guard<std::mutex> lock(propagation_mutex_);
+    imu_propagator_.clear();
+    propagate_imu_ = imu_propagation_ && ModeT::index == basic_state_estimator::OdomOnlyMode::index;
+  }
+}
+
+void BasicStateEstimator::selectPipeline()
+{
+  // The last enabled source wins
+  if (sensor_fusion_)
+  {
+    selectPipeline<basic_state_estimator::SensorFusionMode>();
+  }
+  else if (ground_truth_)
+  {
+    selectPipeline<basic_state_estimator::GroundTruthMode>();
+  }
+  else
+  {
+    selectPipeline<basic_state_estimator::OdomOnlyMode>();
+  }
+}
+
+// WARM START //
+
+void BasicStateEstimator::loadSnapshot()
+{
+  snapshot_loaded_ = false;
+  if (!snapshot_.isOpen())
+  {
+    return;
+  }
+  if (!snapshot_.read(snapshot_state_))
+  {
+    RCLCPP_INFO(get_logger(), "NO STATE SNAPSHOT TO RESTORE");
+    return;
+  }
+  double max_age;
+  this->get_parameter("snapshot.max_age", max_age);
+  const double age = (this->get_clock()->now().nanoseconds() - snapshot_state_.stamp) * 1e-9;
+  if (age < 0.0 || age > max_age || snapshot_state_.mode >= mode_names.size())
+  {
+    RCLCPP_WARN(get_logger(), "STATE SNAPSHOT DISCARDED, AGE: %.3f s", age);
+    return;
+  }
+  snapshot_loaded_ = true;
+  RCLCPP_INFO(get_logger(), "RESTORING STATE SNAPSHOT, AGE: %.3f s", age);
+}
+
+void BasicStateEstimator::restoreSnapshot()
+{
+  using basic_state_estimator::fromSnapshot;
+  const basic_state_estimator::SnapshotState &state = snapshot_state_;
+  const rclcpp::Time stamp(state.stamp, this->get_clock()->get_clock_type());
+  const basic_state_estimator::Pose map2baselink = fromSnapshot(state.map2baselink);
+  core_.restore(map2baselink, fromSnapshot(state.mode_offset), state.mode_offset_active != 0);
+  map2odom_ = fromSnapshot(state.map2odom);
+  odom2baselink_ = fromSnapshot(state.odom2baselink);
+  odom_stamp_ = stamp;
+  odom_linear_velocity_ = fromSnapshot(state.odom_linear_velocity);
+  odom_angular_velocity_ = fromSnapshot(state.odom_angular_velocity);
+  global2baselink_ = core_.globalPose(map2odom_, odom2baselink_);
+  global_linear_velocity_ = fromSnapshot(state.global_linear_velocity);
+  global_angular_velocity_ = fromSnapshot(state.global_angular_velocity);
+  estimation_stamp_ = stamp;
+
+  if (sensor_fusion_)
+  {
+    // The filter starts at the saved state instead of at its first measurement
+    std::lock_guard<std::mutex> lock(fusion_mutex_);
+    fusion_filter_.initialize(state.stamp, map2baselink.position, map2baselink.orientation,
+                              core_.global2map().orientation.conjugate() *
+                                  global_linear_velocity_);
+    publishFusionState();
+  }
+
+  if (state.mode != activeMode())
+  {
+    // Saved by another mode, its source continues from the saved pose as on a mode switch
+    core_.beginHandover();
+    return;
+  }
+  if (ground_truth_)
+  {
+    gt_pose_ = odom2baselink_;
+    gt_pose_stamp_ = stamp;
+    assignFrameId(gt_twist_frame_, global_ref_frame_);
+    gt_linear_velocity_ = global_linear_velocity_;
+    gt_angular_velocity_ = global_angular_velocity_;
+  }
+  // The next cycle publishes the restored state, before any new input
+  start_run_ = true;
+  pending_estimation_ = publish_on_input_;
 }
 
-void BasicStateEstimator::run()
+void BasicStateEstimator::saveSnapshot()
 {
-  if (!start_run_)
+  if (!snapshot_.isOpen())
   {
     return;
   }
-  // TODO: SENSOR FUSION
-  geometry_msgs::msg::Transform map2odom_tf;
-  map2odom_tf = calculateLocalization();
-  updateOdomTfDrift(odom2baselink_tf_.transform, map2odom_tf);
-  publishTfs();
-  getGlobalRefState();
-  publishStateEstimation();
+  const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (now - last_snapshot_time_ < snapshot_period_)
+  {
+    return;
+  }
+  last_snapshot_time_ = now;
+
+  using basic_state_estimator::toSnapshot;
+  basic_state_estimator::SnapshotState &state = snapshot_state_;
+  basic_state_estimator::Pose mode_offset;
+  state.stamp = estimation_stamp_.nanoseconds();
+  state.mode = static_cast<uint32_t>(activeMode());
+  state.mode_offset_active = core_.modeOffset(mode_offset) ? 1 : 0;
+  state.global2map = toSnapshot(core_.global2map());
+  state.map2odom = toSnapshot(map2odom_);
+  state.odom2baselink = toSnapshot(odom2baselink_);
+  state.map2baselink = toSnapshot(core_.lastMap2Baselink());
+  state.mode_offset = toSnapshot(mode_offset);
+  state.odom_linear_velocity = toSnapshot(odom_linear_velocity_);
+  state.odom_angular_velocity = toSnapshot(odom_angular_velocity_);
+  state.global_linear_velocity = toSnapshot(global_linear_velocity_);
+  state.global_angular_velocity = toSnapshot(global_angular_velocity_);
+  snapshot_.write(state);
 }
 
-void BasicStateEstimator::setupNode()
+// STATE HISTORY //
+
+void BasicStateEstimator::recordState()
 {
-  // Initialize the transform broadcaster
-  tf_broadcaster_ = std::make_unique<tf2_ros::TransformBroadcaster>(*this);
-  tfstatic_broadcaster_ = std::make_shared<tf2_ros::StaticTransformBroadcaster>(this);
-  tf_buffer_ = std::make_shared<tf2_ros::Buffer>(this->get_clock());
-  tf_listener_ = std::make_shared<tf2_ros::TransformListener>(*tf_buffer_);
+  basic_state_estimator::StateSample sample;
+  sample.stamp = estimation_stamp_.nanoseconds();
+  sample.position = global2baselink_.position;
+  sample.orientation = global2baselink_.orientation;
+  sample.linear_velocity = global_linear_velocity_;
+  sample.angular_velocity = global_angular_velocity_;
 
-  odom_sub_ = this->create_subscription<nav_msgs::msg::Odometry>(
-      this->generate_global_name(as2_names::topics::sensor_measurements::odom),
-      as2_names::topics::sensor_measurements::qos,
-      std::bind(&BasicStateEstimator::odomCallback, this, std::placeholders::_1));
+  std::lock_guard<std::mutex> lock(state_history_mutex_);
+  // The table only grows when the twist frame changes to a new one, on a mode switch
+  auto frame = std::find(state_history_frames_.begin(), state_history_frames_.end(),
+                         global_twist_frame_);
+  if (frame == state_history_frames_.end())
+  {
+    frame = state_history_frames_.insert(frame, global_twist_frame_);
+  }
+  sample.twist_frame = static_cast<std::size_t>(frame - state_history_frames_.begin());
+  // Cycles without a new measurement repeat the last stamp and are not recorded
+  state_history_.push(sample);
+}
 
-  gt_pose_sub_ = this->create_subscription<geometry_msgs::msg::PoseStamped>(
-      this->generate_global_name(as2_names::topics::ground_truth::pose),
-      as2_names::topics::sensor_measurements::qos,
-      std::bind(&BasicStateEstimator::gtPoseCallback, this, std::placeholders::_1));
+void BasicStateEstimator::getStateAtTimeCallback(
+    const basic_state_estimator::srv::GetStateAtTime::Request::SharedPtr _request,
+    basic_state_estimator::srv::GetStateAtTime::Response::SharedPtr _response)
+{
+  basic_state_estimator::StateSample sample;
+  {
+    std::lock_guard<std::mutex> lock(state_history_mutex_);
+    _response->success = state_history_.lookup(rclcpp::Time(_request->stamp).nanoseconds(), sample);
+    if (_response->success)
+    {
+      _response->twist.header.frame_id = state_history_frames_[sample.twist_frame];
+    }
+    _response->pose.header.frame_id = global_ref_frame_;
+  }
+  if (!_response->success)
+  {
+    _response->message = "Stamp out of the state history";
+    return;
+  }
 
-  gt_twist_sub_ = this->create_subscription<geometry_msgs::msg::TwistStamped>(
-      this->generate_global_name(as2_names::topics::ground_truth::twist),
-      as2_names::topics::sensor_measurements::qos,
-      std::bind(&BasicStateEstimator::gtTwistCallback, this, std::placeholders::_1));
+  _response->pose.header.stamp = _request->stamp;
+  basic_state_estimator::toMsg(sample.position, _response->pose.pose.position);
+  basic_state_estimator::toMsg(sample.orientation, _response->pose.pose.orientation);
 
-  pose_estimated_pub_ = this->create_publisher<geometry_msgs::msg::PoseStamped>(
-      as2_names::topics::self_localization::pose, as2_names::topics::self_localization::qos);
-  twist_estimated_pub_ = this->create_publisher<geometry_msgs::msg::TwistStamped>(
-      as2_names::topics::self_localization::twist, as2_names::topics::self_localization::qos);
+  // Frame the twist was published in at that stamp, the ground truth one in ground truth mode
+  _response->twist.header.stamp = _request->stamp;
+  basic_state_estimator::toMsg(sample.linear_velocity, _response->twist.twist.linear);
+  basic_state_estimator::toMsg(sample.angular_velocity, _response->twist.twist.angular);
 }
 
-void BasicStateEstimator::setupTfTree()
-{
-  std::string base_frame;
-  this->get_parameter("base_frame", base_frame);
-  this->get_parameter("odom_only", odom_only_);
-  this->get_parameter("ground_truth", ground_truth_);
-  this->get_parameter("sensor_fusion", sensor_fusion_);
+// PUBLISH //
 
-  if (odom_only_)
+void BasicStateEstimator::publishTfs()
+{
+  // Outputs carry the stamp of the measurement they come from
+  const rclcpp::Time &timestamp = estimation_stamp_;
+  if (timestamp == last_sent_tf_stamp_)
   {
-    RCLCPP_INFO(get_logger(), "ODOM ONLY MODE");
+    // Already sent for this measurement, tf listeners reject repeated stamps
+    return;
   }
-
-  if (ground_truth_)
+  last_sent_tf_stamp_ = timestamp;
+  const bool send_map2odom = !tf_map2odom_on_change_ || map2odomChanged(timestamp);
+  // Only stamps and transforms are written, the frame ids were set in setupTfTree()
+  tf2_msgs::msg::TFMessage &tf_msg = send_map2odom ? tf_msg_ : odom_tf_msg_;
+  if (send_map2odom)
   {
-    RCLCPP_INFO(get_logger(), "GROUND TRUTH MODE");
+    last_sent_map2odom_ = map2odom_;
+    last_sent_map2odom_time_ = timestamp;
+    tf_msg.transforms.front().header.stamp = timestamp;
+    basic_state_estimator::toMsg(map2odom_, tf_msg.transforms.front().transform);
+  }
+  tf_msg.transforms.back().header.stamp = timestamp;
+  basic_state_estimator::toMsg(odom2baselink_, tf_msg.transforms.back().transform);
+  // Single /tf message per cycle, or per host cycle when batched with other estimators
+  if (tf_batch_)
+  {
+    tf_batch_->add(tf_msg.transforms);
+    return;
   }
+  publishMessage(*tf_pub_, tf_msg, send_map2odom ? tf_reserve_ : odom_tf_reserve_, intra_process_,
+                 [&tf_msg](tf2_msgs::msg::TFMessage &_msg) { _msg = tf_msg; });
+}
 
-  if (sensor_fusion_)
+bool BasicStateEstimator::map2odomChanged(const rclcpp::Time &_timestamp) const
+{
+  // Resend periodically so listeners can still interpolate between the odom -> base_link samples
+  if ((_timestamp - last_sent_map2odom_time_).seconds() >= tf_map2odom_keepalive_)
   {
-    RCLCPP_INFO(get_logger(), "SENSOR FUSION MODE");
+    return true;
   }
+  // Tolerance absorbs the rounding of q * q^-1 in odom only mode
+  constexpr double tolerance = 1e-6;
+  return (map2odom_.position - last_sent_map2odom_.position).cwiseAbs().maxCoeff() > tolerance ||
+         1.0 - std::abs(last_sent_map2odom_.orientation.dot(map2odom_.orientation)) > tolerance;
+}
 
-  if (!odom_only_ & !ground_truth_ & !sensor_fusion_)
+void BasicStateEstimator::publishStaticTfs()
+{
+  // Static transforms are latched, only send them again if any of them changed
+  auto same_transform = [](const geometry_msgs::msg::TransformStamped &_lhs,
+                           const geometry_msgs::msg::TransformStamped &_rhs) {
+    return _lhs.header.frame_id == _rhs.header.frame_id &&
+           _lhs.child_frame_id == _rhs.child_frame_id && _lhs.transform == _rhs.transform;
+  };
+  if (std::equal(tf2_fix_transforms_.begin(), tf2_fix_transforms_.end(),
+                 published_fix_transforms_.begin(), published_fix_transforms_.end(),
+                 same_transform))
   {
-    RCLCPP_ERROR(get_logger(), "NO ESTIMATION MODE ENABLED");
-    RCLCPP_ERROR(get_logger(), "DEFAULT: ODOM ONLY ACTIVATED");
-    odom_only_ = true;
+    return;
   }
 
-  tf2_fix_transforms_.clear();
-  // global reference to drone reference
-  std::string ns = this->get_namespace();
-  global_ref_frame_ = "earth";
-  map_frame_ = generateTfName(ns, "map");
-  odom_frame_ = generateTfName(ns, "odom");
-  if (base_frame == "")
+  rclcpp::Time timestamp = this->get_clock()->now();
+  for (geometry_msgs::msg::TransformStamped &transform : tf2_fix_transforms_)
   {
-    baselink_frame_ = ns.substr(1, ns.length());
-    RCLCPP_WARN(get_logger(), "NO BASE FRAME SPECIFIED , USING DEFAULT: %s", baselink_frame_.c_str());
+    transform.header.stamp = timestamp;
+  }
+  if (tf_batch_)
+  {
+    tf_batch_->addStatic(tf2_fix_transforms_);
   }
   else
   {
-    baselink_frame_ = generateTfName(ns, base_frame);
+    tfstatic_broadcaster_->sendTransform(tf2_fix_transforms_);
   }
+  published_fix_transforms_ = tf2_fix_transforms_;
+}
 
-  getStartingPose(global_ref_frame_, map_frame_);
+void BasicStateEstimator::publishStateEstimation(const bool _new_data)
+{
+  publishMessage(*pose_estimated_pub_, pose_msg_, pose_reserve_, intra_process_,
+                 [this](geometry_msgs::msg::PoseStamped &_msg) {
+                   generatePoseStampedMsg(estimation_stamp_, _msg);
+                 });
+  publishMessage(*twist_estimated_pub_, twist_msg_, twist_reserve_, intra_process_,
+                 [this](geometry_msgs::msg::TwistStamped &_msg) {
+                   generateTwistStampedMsg(estimation_stamp_, _msg);
+                 });
+  if (publish_covariance_)
+  {
+    publishMessage(*pose_covariance_pub_, pose_covariance_msg_, pose_covariance_reserve_,
+                   intra_process_, [this](geometry_msgs::msg::PoseWithCovarianceStamped &_msg) {
+                     generatePoseCovarianceMsg(estimation_stamp_, _msg);
+                   });
+    publishMessage(*twist_covariance_pub_, twist_covariance_msg_, twist_covariance_reserve_,
+                   intra_process_, [this](geometry_msgs::msg::TwistWithCovarianceStamped &_msg) {
+                     generateTwistCovarianceMsg(estimation_stamp_, _msg);
+                   });
+  }
+  if (_new_data)
+  {
+    // Heartbeats republish an old estimate, they are not input latency
+    latency_stats_[activeMode()].addSample(
+        (this->get_clock()->now() - estimation_stamp_).seconds());
+  }
+}
 
-  // init map_2_odom
-  map2odom_tf_.header.frame_id = map_frame_;
-  map2odom_tf_.child_frame_id = odom_frame_;
-  map2odom_tf_.transform.rotation.w = 1.0f;
+std::size_t BasicStateEstimator::activeMode() const { return pipeline_.mode; }
 
-  // init odom_2_baselink
-  odom2baselink_tf_.header.frame_id = odom_frame_;
-  odom2baselink_tf_.child_frame_id = baselink_frame_;
-  odom2baselink_tf_.transform.rotation.w = 1.0f;
+void BasicStateEstimator::publishDiagnostics()
+{
+  // The statistics are written by the estimation, which may be running from a callback thread.
+  // Skip this report rather than block it.
+  if (estimation_in_progress_.exchange(true, std::memory_order_acquire))
+  {
+    return;
+  }
+  diagnostic_msgs::msg::DiagnosticStatus status;
+  status.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+  status.name = std::string(this->get_fully_qualified_name()) + ": latency";
+  status.message = "Input to publish latency [ms]";
+  status.hardware_id = this->get_namespace();
+  for (std::size_t mode = 0; mode < latency_stats_.size(); mode++)
+  {
+    double p50, p99, max;
+    if (!latency_stats_[mode].getPercentiles(p50, p99, max))
+    {
+      continue;
+    }
+    const std::string mode_name = mode_names[mode];
+    status.values.emplace_back(makeKeyValue(mode_name + ".p50", p50 * 1e3));
+    status.values.emplace_back(makeKeyValue(mode_name + ".p99", p99 * 1e3));
+    status.values.emplace_back(makeKeyValue(mode_name + ".max", max * 1e3));
+    status.values.emplace_back(
+        makeKeyValue(mode_name + ".samples", static_cast<double>(latency_stats_[mode].count())));
+  }
+  if (odom_sources_.size() > 1)
+  {
+    const std::size_t active = active_odom_source_.load(std::memory_order_relaxed);
+    status.values.emplace_back(makeKeyValue("odometry.source", static_cast<double>(active)));
+    status.values.emplace_back(
+        makeKeyValue("odometry.failovers", static_cast<double>(odom_failovers_)));
+  }
+  estimation_in_progress_.store(false, std::memory_order_release);
+  for (std::size_t topic = 0; topic < QOS_COUNT; topic++)
+  {
+    if (qos_deadline_[topic])
+    {
+      const uint64_t missed = deadlines_missed_[topic].load(std::memory_order_relaxed);
+      status.values.emplace_back(makeKeyValue(
+          std::string("qos.") + qos_names[topic] + ".deadlines_missed",
+          static_cast<double>(missed)));
+    }
+  }
+  if (sensor_fusion_)
+  {
+    std::lock_guard<std::mutex> lock(fusion_mutex_);
+    status.values.emplace_back(makeKeyValue(
+        "fusion.replayed_inputs", static_cast<double>(fusion_filter_.replayedInputs())));
+    status.values.emplace_back(makeKeyValue("fusion.dropped_inputs",
+                                            static_cast<double>(fusion_filter_.droppedInputs())));
+  }
+  if (realtime_loop_)
+  {
+    // Wake up jitter of the loop since the previous report
+    double jitter_mean, jitter_max;
+    if (realtime_loop_->wakeUpJitter().take(jitter_mean, jitter_max))
+    {
+      status.values.emplace_back(makeKeyValue("realtime.jitter_mean_us", jitter_mean));
+      status.values.emplace_back(makeKeyValue("realtime.jitter_max_us", jitter_max));
+    }
+    status.values.emplace_back(
+        makeKeyValue("realtime.overruns", static_cast<double>(realtime_loop_->overruns())));
+    status.values.emplace_back(
+        makeKeyValue("realtime.sched_fifo", realtime_loop_->isRealtime() ? 1.0 : 0.0));
+  }
 
-  RCLCPP_INFO(get_logger(), "%s -> %s", global_ref_frame_.c_str(), map_frame_.c_str());
-  RCLCPP_INFO(get_logger(), "%s -> %s", map2odom_tf_.header.frame_id.c_str(),
-              map2odom_tf_.child_frame_id.c_str());
-  RCLCPP_INFO(get_logger(), "%s -> %s", odom2baselink_tf_.header.frame_id.c_str(),
-              odom2baselink_tf_.child_frame_id.c_str());
+  diagnostic_msgs::msg::DiagnosticArray diagnostics;
+  diagnostics.header.stamp = this->get_clock()->now();
+  diagnostics.status.emplace_back(std::move(status));
+#ifdef BASIC_STATE_ESTIMATOR_INSTRUMENTATION
+  diagnostics.status.emplace_back(instrumentationStatus());
+#endif
+  diagnostics_pub_->publish(diagnostics);
+}
 
-  start_run_ = false;
+#ifdef BASIC_STATE_ESTIMATOR_INSTRUMENTATION
+diagnostic_msgs::msg::DiagnosticStatus BasicStateEstimator::instrumentationStatus()
+{
+  diagnostic_msgs::msg::DiagnosticStatus status;
+  status.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+  status.name = std::string(this->get_fully_qualified_name()) + ": instrumentation";
+  status.message = "Stage times [us] and input counters since the previous report";
+  status.hardware_id = this->get_namespace();
+  for (std::size_t stage = 0; stage < stage_stats_.size(); stage++)
+  {
+    double mean, max;
+    if (stage_stats_[stage].take(mean, max))
+    {
+      const std::string stage_name = stage_names[stage];
+      status.values.emplace_back(makeKeyValue(stage_name + ".mean", mean));
+      status.values.emplace_back(makeKeyValue(stage_name + ".max", max));
+    }
+  }
+  double mean, max;
+  if (odom_age_.take(mean, max))
+  {
+    status.values.emplace_back(makeKeyValue("odom_age.mean", mean));
+    status.values.emplace_back(makeKeyValue("odom_age.max", max));
+  }
+  const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  for (std::size_t input = 0; input < received_.size(); input++)
+  {
+    const std::string input_name = input_names[input];
+    status.values.emplace_back(
+        makeKeyValue(input_name + ".received", static_cast<double>(received_[input].total())));
+    status.values.emplace_back(makeKeyValue(input_name + ".rate", received_[input].takeRate(now)));
+    status.values.emplace_back(
+        makeKeyValue(input_name + ".dropped", static_cast<double>(dropped_[input].total())));
+  }
+  status.values.emplace_back(makeKeyValue("merged", static_cast<double>(merged_.total())));
+  status.values.emplace_back(makeKeyValue("skipped", static_cast<double>(skipped_.total())));
+  status.values.emplace_back(
+      makeKeyValue("tf_lookup_failures", static_cast<double>(tf_lookup_failures_.total())));
+  return status;
+}
+#endif
 
-  // // init Tf tree
-  // publishTfs();
+void BasicStateEstimator::generatePoseStampedMsg(const rclcpp::Time &_timestamp,
+                                                 geometry_msgs::msg::PoseStamped &_pose_stamped)
+{
+  _pose_stamped.header.stamp = _timestamp;
+  assignFrameId(_pose_stamped.header.frame_id, global_ref_frame_);
+  basic_state_estimator::toMsg(global2baselink_, _pose_stamped.pose);
 }
 
-void BasicStateEstimator::getStartingPose(const std::string &_global_frame,
-                                          const std::string &_map)
+void BasicStateEstimator::generateTwistStampedMsg(const rclcpp::Time &_timestamp,
+                                                  geometry_msgs::msg::TwistStamped &_twist_stamped)
 {
-  // TODO: Get starting pose
+  _twist_stamped.header.stamp = _timestamp;
+  // TODO:Review ref frame
+  assignFrameId(_twist_stamped.header.frame_id, global_twist_frame_);
+  basic_state_estimator::toMsg(global_linear_velocity_, _twist_stamped.twist.linear);
+  basic_state_estimator::toMsg(global_angular_velocity_, _twist_stamped.twist.angular);
+}
 
-  // Default
-  tf2_fix_transforms_.emplace_back(getTransformation(_global_frame, _map, 0, 0, 0, 0, 0, 0));
+void BasicStateEstimator::generatePoseCovarianceMsg(
+    const rclcpp::Time &_timestamp, geometry_msgs::msg::PoseWithCovarianceStamped &_pose)
+{
+  _pose.header.stamp = _timestamp;
+  assignFrameId(_pose.header.frame_id, global_ref_frame_);
+  basic_state_estimator::toMsg(global2baselink_, _pose.pose.pose);
+  basic_state_estimator::toMsg(pose_covariance_, _pose.pose.covariance);
 }
 
-void BasicStateEstimator::updateOdomTfDrift(const geometry_msgs::msg::Transform _odom2baselink,
-                                            const geometry_msgs::msg::Transform _map2baselink)
+void BasicStateEstimator::generateTwistCovarianceMsg(
+    const rclcpp::Time &_timestamp, geometry_msgs::msg::TwistWithCovarianceStamped &_twist)
 {
-  map2odom_tf_.transform.translation.x = _map2baselink.translation.x - _odom2baselink.translation.x;
-  map2odom_tf_.transform.translation.y = _map2baselink.translation.y - _odom2baselink.translation.y;
-  map2odom_tf_.transform.translation.z = _map2baselink.translation.z - _odom2baselink.translation.z;
+  _twist.header.stamp = _timestamp;
+  assignFrameId(_twist.header.frame_id, global_twist_frame_);
+  basic_state_estimator::toMsg(global_linear_velocity_, _twist.twist.twist.linear);
+  basic_state_estimator::toMsg(global_angular_velocity_, _twist.twist.twist.angular);
+  basic_state_estimator::toMsg(twist_covariance_, _twist.twist.covariance);
+}
 
-  // Calculate relative orientation
-  tf2::Quaternion map2baselink_orientation(_map2baselink.rotation.x, _map2baselink.rotation.y,
-                                           _map2baselink.rotation.z, _map2baselink.rotation.w);
-  tf2::Quaternion odom2baselink_orientation(_odom2baselink.rotation.x, _odom2baselink.rotation.y,
-                                            _odom2baselink.rotation.z, _odom2baselink.rotation.w);
-  tf2::Quaternion map2odom_orientation =
-      map2baselink_orientation * tf2::inverse(odom2baselink_orientation);
+// CALLBACKS //
 
-  map2odom_tf_.transform.rotation.x = map2odom_orientation.x();
-  map2odom_tf_.transform.rotation.y = map2odom_orientation.y();
-  map2odom_tf_.transform.rotation.z = map2odom_orientation.z();
-  map2odom_tf_.transform.rotation.w = map2odom_orientation.w();
-}
+// Callbacks only hand their samples to the estimation through the triple buffers
 
-geometry_msgs::msg::Transform BasicStateEstimator::calculateLocalization()
+void BasicStateEstimator::odomCallback(const nav_msgs::msg::Odometry::SharedPtr _msg,
+                                       const std::size_t _source)
 {
-  geometry_msgs::msg::Transform map2baselink;
-  if (odom_only_)
+  if (!active_.load(std::memory_order_relaxed))
   {
-    map2baselink = odom2baselink_tf_.transform;
+    return;
   }
-  if (ground_truth_)
+  BSE_COUNT(received_[INPUT_ODOM]);
+  OdomSource &source = odom_sources_[_source];
+  const std::chrono::steady_clock::rep now =
+      std::chrono::steady_clock::now().time_since_epoch().count();
+  const std::chrono::steady_clock::rep previous =
+      source.last_receipt.exchange(now, std::memory_order_relaxed);
+  if (previous == 0 || now - previous > source.timeout)
   {
-    map2baselink.translation.x = gt_pose_.position.x;
-    map2baselink.translation.y = gt_pose_.position.y;
-    map2baselink.translation.z = gt_pose_.position.z;
-    map2baselink.rotation.x = gt_pose_.orientation.x;
-    map2baselink.rotation.y = gt_pose_.orientation.y;
-    map2baselink.rotation.z = gt_pose_.orientation.z;
-    map2baselink.rotation.w = gt_pose_.orientation.w;
-    odom2baselink_tf_.transform = map2baselink;
+    // Delivering again after being stale, the recovery time starts over
+    source.healthy_since.store(now, std::memory_order_relaxed);
   }
-  if (sensor_fusion_)
+  const std::size_t active = active_odom_source_.load(std::memory_order_acquire);
+  if (_source != active)
   {
-    // TODO: SENSOR FUSION
+    // Only tracked for the arbitration, a flapping source does not trigger a handover each way
+    if (_source < active && isOdomSourceRecovered(_source, now))
+    {
+      recovered_odom_sources_.fetch_or(1u << _source, std::memory_order_release);
+    }
+    return;
+  }
+  if (imu_propagation_)
+  {
+    propagateOdometry(*_msg, _source);
+  }
+  else
+  {
+    writeOdomSample(*_msg, _source);
+  }
+
+  if (fuse_inputs_)
+  {
+    fuseOdometry(*_msg, _source);
   }
-  return map2baselink;
+  onInputReceived();
 }
 
-void BasicStateEstimator::getGlobalRefState()
+void BasicStateEstimator::gtPoseCallback(const geometry_msgs::msg::PoseStamped::SharedPtr _msg)
 {
-  try
+  if (!active_.load(std::memory_order_relaxed))
   {
-    auto pose_transform =
-        tf_buffer_->lookupTransform(global_ref_frame_, baselink_frame_, tf2::TimePointZero);
-    global_ref_pose.position.x = pose_transform.transform.translation.x;
-    global_ref_pose.position.y = pose_transform.transform.translation.y;
-    global_ref_pose.position.z = pose_transform.transform.translation.z;
-    global_ref_pose.orientation.x = pose_transform.transform.rotation.x;
-    global_ref_pose.orientation.y = pose_transform.transform.rotation.y;
-    global_ref_pose.orientation.z = pose_transform.transform.rotation.z;
-    global_ref_pose.orientation.w = pose_transform.transform.rotation.w;
+    return;
   }
-  catch (tf2::TransformException &ex)
+  writeGtPose(*_msg);
+  onInputReceived();
+}
+
+void BasicStateEstimator::gtTwistCallback(const geometry_msgs::msg::TwistStamped::SharedPtr _msg)
+{
+  if (!active_.load(std::memory_order_relaxed))
   {
-    RCLCPP_WARN(this->get_logger(), "Transform Failure: %s\n",
-                ex.what()); // Print exception which was caught
+    return;
   }
+  writeGtTwist(*_msg);
+  start_run_ = true;
+}
 
-  if (odom_only_)
+void BasicStateEstimator::writeGtPose(const geometry_msgs::msg::PoseStamped &_msg)
+{
+  BSE_COUNT(received_[INPUT_GT_POSE]);
+  geometry_msgs::msg::PoseStamped &gt_pose = gt_pose_buffer_.write();
+  gt_pose.header.stamp = _msg.header.stamp;
+  gt_pose.pose = _msg.pose;
+  if (gt_pose_buffer_.publish())
+  {
+    BSE_COUNT(dropped_[INPUT_GT_POSE]);
+  }
+  if (fuse_inputs_)
   {
-    global_ref_twist.header.frame_id = global_ref_frame_;
-    global_ref_twist.twist.angular = odom_twist_.twist.angular;
-    tf2::Quaternion orientation(
-        global_ref_pose.orientation.x, global_ref_pose.orientation.y, global_ref_pose.orientation.z,
-        global_ref_pose.orientation.w);
+    fuseAbsolutePose(_msg);
+  }
+}
 
-    // odom2baselink_tf_.transform.rotation.x, odom2baselink_tf_.transform.rotation.y,
-    // odom2baselink_tf_.transform.rotation.z, odom2baselink_tf_.transform.rotation.w);
+void BasicStateEstimator::writeGtTwist(const geometry_msgs::msg::TwistStamped &_msg)
+{
+  BSE_COUNT(received_[INPUT_GT_TWIST]);
+  geometry_msgs::msg::TwistStamped &gt_twist = gt_twist_buffer_.write();
+  gt_twist.header.stamp = _msg.header.stamp;
+  assignFrameId(gt_twist.header.frame_id, _msg.header.frame_id);
+  gt_twist.twist = _msg.twist;
+  if (gt_twist_buffer_.publish())
+  {
+    BSE_COUNT(dropped_[INPUT_GT_TWIST]);
+  }
+}
 
-    Eigen::Vector3d odom_linear_twist(odom_twist_.twist.linear.x, odom_twist_.twist.linear.y,
-                                      odom_twist_.twist.linear.z);
-    Eigen::Vector3d global_linear_twist =
-        as2::FrameUtils::convertFLUtoENU(orientation, odom_linear_twist);
-    global_ref_twist.twist.linear.x = global_linear_twist.x();
-    global_ref_twist.twist.linear.y = global_linear_twist.y();
-    global_ref_twist.twist.linear.z = global_linear_twist.z();
+void BasicStateEstimator::takeGroundTruth()
+{
+  // The keep last 1 queues only hold the newest sample, taken into preallocated messages
+  rclcpp::MessageInfo message_info;
+  if (gt_pose_sub_->take(gt_pose_taken_, message_info))
+  {
+    writeGtPose(gt_pose_taken_);
+    start_run_ = true;
+  }
+  if (gt_twist_sub_->take(gt_twist_taken_, message_info))
+  {
+    writeGtTwist(gt_twist_taken_);
+    start_run_ = true;
   }
+}
 
-  if (ground_truth_)
+void BasicStateEstimator::imuCallback(const sensor_msgs::msg::Imu::SharedPtr _msg)
+{
+  if (!active_.load(std::memory_order_relaxed))
+  {
+    return;
+  }
+  BSE_COUNT(received_[INPUT_IMU]);
+  if (propagate_imu_ && propagateImu(*_msg))
+  {
+    onInputReceived();
+  }
+  if (!fuse_inputs_)
+  {
+    return;
+  }
+  const rclcpp::Time stamp = _msg->header.stamp;
+  std::lock_guard<std::mutex> lock(fusion_mutex_);
+  if (!fusion_filter_.addImu(stamp.nanoseconds(),
+                             basic_state_estimator::fromMsg(_msg->linear_acceleration),
+                             basic_state_estimator::fromMsg(_msg->angular_velocity)))
   {
-    global_ref_twist = gt_twist_;
+    BSE_COUNT(dropped_[INPUT_IMU]);
+    return;
   }
+  publishFusionState();
+}
 
-  if (sensor_fusion_)
-  { // TODO: Sensor fusion
+void BasicStateEstimator::writeOdomSample(const nav_msgs::msg::Odometry &_msg,
+                                          const std::size_t _source)
+{
+  OdomSample &odom = odom_buffer_.write();
+  odom.source = _source;
+  odom.stamp = _msg.header.stamp;
+  odom.pose = basic_state_estimator::fromMsg(_msg.pose.pose);
+  odom.linear_velocity = basic_state_estimator::fromMsg(_msg.twist.twist.linear);
+  odom.angular_velocity = basic_state_estimator::fromMsg(_msg.twist.twist.angular);
+  if (publish_covariance_)
+  {
+    odom.pose_covariance = basic_state_estimator::covarianceFromMsg(_msg.pose.covariance);
+    odom.twist_covariance = basic_state_estimator::covarianceFromMsg(_msg.twist.covariance);
+  }
+  if (odom_buffer_.publish())
+  {
+    BSE_COUNT(dropped_[INPUT_ODOM]);
   }
 }
 
-// PUBLISH //
+// IMU PROPAGATION //
 
-void BasicStateEstimator::publishTfs()
+void BasicStateEstimator::propagateOdometry(const nav_msgs::msg::Odometry &_msg,
+                                            const std::size_t _source)
 {
-  rclcpp::Time timestamp = this->get_clock()->now();
-  for (geometry_msgs::msg::TransformStamped &transform : tf2_fix_transforms_)
+  std::lock_guard<std::mutex> lock(propagation_mutex_);
+  if (!propagate_imu_)
   {
-    transform.header.stamp = timestamp;
-    tfstatic_broadcaster_->sendTransform(transform);
+    writeOdomSample(_msg, _source);
+    return;
+  }
+  propagated_source_ = _source;
+  // Odometry twist is in the body frame
+  const basic_state_estimator::Pose pose = basic_state_estimator::fromMsg(_msg.pose.pose);
+  imu_propagator_.reset(rclcpp::Time(_msg.header.stamp).nanoseconds(), pose.position,
+                        pose.orientation,
+                        pose.orientation * basic_state_estimator::fromMsg(_msg.twist.twist.linear),
+                        basic_state_estimator::fromMsg(_msg.twist.twist.angular));
+  if (publish_covariance_)
+  {
+    // Kept for the propagated samples, the propagation itself does not grow them
+    propagated_pose_covariance_ = basic_state_estimator::covarianceFromMsg(_msg.pose.covariance);
+    propagated_twist_covariance_ = basic_state_estimator::covarianceFromMsg(_msg.twist.covariance);
+  }
+  // Already moved to the IMU samples newer than this odometry sample, if any
+  if (publishPropagatedState())
+  {
+    BSE_COUNT(dropped_[INPUT_ODOM]);
   }
-  map2odom_tf_.header.stamp = timestamp;
-  tf_broadcaster_->sendTransform(map2odom_tf_);
-  odom2baselink_tf_.header.stamp = timestamp;
-  tf_broadcaster_->sendTransform(odom2baselink_tf_);
 }
 
-void BasicStateEstimator::publishStateEstimation()
+bool BasicStateEstimator::propagateImu(const sensor_msgs::msg::Imu &_msg)
 {
-  rclcpp::Time timestamp = this->get_clock()->now();
-  pose_estimated_pub_->publish(generatePoseStampedMsg(timestamp));
-  twist_estimated_pub_->publish(generateTwistStampedMsg(timestamp));
+  std::lock_guard<std::mutex> lock(propagation_mutex_);
+  if (!propagate_imu_ ||
+      !imu_propagator_.addImu(rclcpp::Time(_msg.header.stamp).nanoseconds(),
+                              basic_state_estimator::fromMsg(_msg.linear_acceleration),
+                              basic_state_estimator::fromMsg(_msg.angular_velocity)))
+  {
+    return false;
+  }
+  publishPropagatedState();
+  return true;
 }
 
-geometry_msgs::msg::PoseStamped BasicStateEstimator::generatePoseStampedMsg(
-    const rclcpp::Time &_timestamp)
+bool BasicStateEstimator::publishPropagatedState()
 {
-  geometry_msgs::msg::PoseStamped pose_stamped;
-  pose_stamped.header.stamp = _timestamp;
-  pose_stamped.header.frame_id = global_ref_frame_;
-  pose_stamped.pose.position = global_ref_pose.position;
-  pose_stamped.pose.orientation = global_ref_pose.orientation;
-  return pose_stamped;
+  const basic_state_estimator::PropagatedState &state = imu_propagator_.state();
+  OdomSample &odom = odom_buffer_.write();
+  odom.source = propagated_source_;
+  odom.stamp = rclcpp::Time(state.stamp, this->get_clock()->get_clock_type());
+  odom.pose.position = state.position;
+  odom.pose.orientation = state.orientation;
+  odom.linear_velocity = state.orientation.conjugate() * state.velocity;
+  odom.angular_velocity = state.angular_velocity;
+  odom.pose_covariance = propagated_pose_covariance_;
+  odom.twist_covariance = propagated_twist_covariance_;
+  return odom_buffer_.publish();
 }
 
-geometry_msgs::msg::TwistStamped BasicStateEstimator::generateTwistStampedMsg(
-    const rclcpp::Time &_timestamp)
+// SENSOR FUSION //
+
+void BasicStateEstimator::setupSensorFusion()
 {
-  geometry_msgs::msg::TwistStamped twist_stamped;
-  twist_stamped.header.stamp = _timestamp;
-  twist_stamped.header.frame_id = global_ref_twist.header.frame_id; // TODO:Review ref frame
-  twist_stamped.twist.linear = global_ref_twist.twist.linear;
-  twist_stamped.twist.angular = global_ref_twist.twist.angular;
-  return twist_stamped;
+  basic_state_estimator::FusionParameters &fusion = fusion_parameters_;
+  this->get_parameter("fusion.acc_noise", fusion.noise.acc_noise);
+  this->get_parameter("fusion.gyro_noise", fusion.noise.gyro_noise);
+  this->get_parameter("fusion.acc_bias_noise", fusion.noise.acc_bias_noise);
+  this->get_parameter("fusion.gyro_bias_noise", fusion.noise.gyro_bias_noise);
+  this->get_parameter("fusion.odom_position_std", fusion.odom_position_std);
+  this->get_parameter("fusion.odom_orientation_std", fusion.odom_orientation_std);
+  this->get_parameter("fusion.odom_velocity_std", fusion.odom_velocity_std);
+  this->get_parameter("fusion.pose_position_std", fusion.pose_position_std);
+  this->get_parameter("fusion.pose_orientation_std", fusion.pose_orientation_std);
+  this->get_parameter("fusion.imu_timeout", fusion.imu_timeout);
+  int replay_window, max_replay_depth;
+  this->get_parameter("fusion.replay_window", replay_window);
+  this->get_parameter("fusion.max_replay_depth", max_replay_depth);
+  fusion.replay_window = static_cast<std::size_t>(std::max(replay_window, 2));
+  fusion.max_replay_depth = static_cast<std::size_t>(std::max(max_replay_depth, 0));
+
+  std::lock_guard<std::mutex> lock(fusion_mutex_);
+  fusion_filter_ = basic_state_estimator::makeFusionFilter(fusion);
 }
 
-// CALLBACKS //
+void BasicStateEstimator::publishFusionState()
+{
+  const basic_state_estimator::ErrorStateEkf &ekf = fusion_filter_.filter();
+  FusionState &state = fusion_buffer_.write();
+  state.stamp = rclcpp::Time(fusion_filter_.stamp(), this->get_clock()->get_clock_type());
+  state.position = ekf.position();
+  state.velocity = ekf.velocity();
+  state.orientation = ekf.orientation();
+  state.angular_velocity = ekf.angularVelocity();
+  state.imu_active = fusion_filter_.isImuActive();
+  if (publish_covariance_)
+  {
+    using basic_state_estimator::ErrorStateEkf;
+    const ErrorStateEkf::CovarianceMatrix &covariance = ekf.covariance();
+    basic_state_estimator::Matrix6d pose_covariance;
+    pose_covariance << covariance.block<3, 3>(ErrorStateEkf::POSITION, ErrorStateEkf::POSITION),
+        covariance.block<3, 3>(ErrorStateEkf::POSITION, ErrorStateEkf::ORIENTATION),
+        covariance.block<3, 3>(ErrorStateEkf::ORIENTATION, ErrorStateEkf::POSITION),
+        covariance.block<3, 3>(ErrorStateEkf::ORIENTATION, ErrorStateEkf::ORIENTATION);
+    // The orientation error is in the body frame
+    state.pose_covariance = basic_state_estimator::rotateCovariance(
+        pose_covariance, Eigen::Matrix3d::Identity(), ekf.orientation().toRotationMatrix());
+    state.twist_covariance.setZero();
+    state.twist_covariance.block<3, 3>(0, 0) =
+        covariance.block<3, 3>(ErrorStateEkf::VELOCITY, ErrorStateEkf::VELOCITY);
+    // Bias corrected gyroscope
+    state.twist_covariance.block<3, 3>(3, 3) =
+        covariance.block<3, 3>(ErrorStateEkf::GYRO_BIAS, ErrorStateEkf::GYRO_BIAS) +
+        fusion_parameters_.noise.gyro_noise * fusion_parameters_.noise.gyro_noise *
+            Eigen::Matrix3d::Identity();
+  }
+  fusion_buffer_.publish();
+}
+
+void BasicStateEstimator::fuseOdometry(const nav_msgs::msg::Odometry &_msg,
+                                       const std::size_t _source)
+{
+  std::lock_guard<std::mutex> lock(fusion_mutex_);
+  // Only started by odometry before any estimate, when the map and odom frames coincide
+  if (basic_state_estimator::fuseOdometry(
+          fusion_filter_, fusion_parameters_, rclcpp::Time(_msg.header.stamp).nanoseconds(),
+          _source, basic_state_estimator::Pose(), basic_state_estimator::fromMsg(_msg.pose.pose),
+          basic_state_estimator::fromMsg(_msg.twist.twist.linear),
+          basic_state_estimator::fromMsg(_msg.twist.twist.angular),
+          basic_state_estimator::covarianceFromMsg(_msg.pose.covariance),
+          basic_state_estimator::covarianceFromMsg(_msg.twist.covariance)))
+  {
+    publishFusionState();
+  }
+}
 
-void BasicStateEstimator::odomCallback(const nav_msgs::msg::Odometry::SharedPtr _msg)
+void BasicStateEstimator::fuseAbsolutePose(const geometry_msgs::msg::PoseStamped &_msg)
 {
-  // rclcpp::Time timestamp = this->get_clock()->now();
-  // odom2baselink_tf_.header.stamp = timestamp;
-  odom2baselink_tf_.transform.translation.x = _msg->pose.pose.position.x;
-  odom2baselink_tf_.transform.translation.y = _msg->pose.pose.position.y;
-  odom2baselink_tf_.transform.translation.z = _msg->pose.pose.position.z;
-  odom2baselink_tf_.transform.rotation.x = _msg->pose.pose.orientation.x;
-  odom2baselink_tf_.transform.rotation.y = _msg->pose.pose.orientation.y;
-  odom2baselink_tf_.transform.rotation.z = _msg->pose.pose.orientation.z;
-  odom2baselink_tf_.transform.rotation.w = _msg->pose.pose.orientation.w;
+  std::lock_guard<std::mutex> lock(fusion_mutex_);
+  if (basic_state_estimator::fuseAbsolutePose(fusion_filter_, fusion_parameters_,
+                                              rclcpp::Time(_msg.header.stamp).nanoseconds(),
+                                              basic_state_estimator::fromMsg(_msg.pose)))
+  {
+    publishFusionState();
+  }
+}
 
-  odom_twist_.header.frame_id = odom_frame_;
-  odom_twist_.twist.linear = _msg->twist.twist.linear;
-  odom_twist_.twist.angular = _msg->twist.twist.angular;
+// LIFECYCLE //
 
-  start_run_ = true;
+template <typename Function> void BasicStateEstimator::forEachPublisher(Function _function)
+{
+  const auto apply = [&_function](auto &_publisher) {
+    if (_publisher)
+    {
+      _function(*_publisher);
+    }
+  };
+  apply(tf_pub_);
+  apply(pose_estimated_pub_);
+  apply(twist_estimated_pub_);
+  apply(pose_covariance_pub_);
+  apply(twist_covariance_pub_);
+  apply(diagnostics_pub_);
 }
 
-void BasicStateEstimator::gtPoseCallback(const geometry_msgs::msg::PoseStamped::SharedPtr _msg)
+void BasicStateEstimator::activateNode()
 {
-  gt_pose_ = _msg->pose;
-  start_run_ = true;
+  setupTfTree();
+  if (!imu_sub_)
+  {
+    createSubscriptions();
+  }
+  forEachPublisher([](auto &_publisher) { _publisher.on_activate(); });
+  if (intra_process_)
+  {
+    startReserveRefill();
+  }
+  active_ = true;
+
+  // Loops created by setupNode() for a previous startRunTimer() or startRealtimeLoop()
+  if (run_timer_)
+  {
+    run_timer_->reset();
+  }
+  if (diagnostics_timer_)
+  {
+    diagnostics_timer_->reset();
+  }
+  if (realtime_loop_ && !realtime_loop_->isRunning())
+  {
+    startRealtimeThread();
+  }
 }
 
-void BasicStateEstimator::gtTwistCallback(const geometry_msgs::msg::TwistStamped::SharedPtr _msg)
+void BasicStateEstimator::deactivateNode()
 {
-  gt_twist_.header.frame_id = _msg->header.frame_id;
-  gt_twist_.twist = _msg->twist;
-  start_run_ = true;
+  active_ = false;
+  if (run_timer_)
+  {
+    run_timer_->cancel();
+  }
+  if (diagnostics_timer_)
+  {
+    diagnostics_timer_->cancel();
+  }
+  stopRealtimeLoop();
+  if (flush_timer_)
+  {
+    flush_timer_->cancel();
+  }
+
+  // Wait for an estimation already running in a callback
+  while (estimation_in_progress_.exchange(true, std::memory_order_acquire))
+  {
+    std::this_thread::yield();
+  }
+  start_run_ = false;
+  pending_estimation_ = false;
+  if (core_.hasMap2Baselink())
+  {
+    // Resumed by the next activation
+    last_snapshot_time_ = std::chrono::steady_clock::time_point();
+    saveSnapshot();
+  }
+  estimation_in_progress_.store(false, std::memory_order_release);
+  reserve_refill_.stop();
+
+  // The buffer keeps its transforms, only the listener thread is stopped
+  tf_listener_.reset();
+  forEachPublisher([](auto &_publisher) { _publisher.on_deactivate(); });
+  if (release_subscriptions_)
+  {
+    releaseSubscriptions();
+  }
 }
 
-void BasicStateEstimator::cleanupNode(){
-    // TODO: CLeanup Node
-};
+void BasicStateEstimator::cleanupNode()
+{
+  releaseSubscriptions();
+  odom_sources_.clear();
+  run_timer_.reset();
+  flush_timer_.reset();
+  diagnostics_timer_.reset();
+  realtime_loop_.reset();
+  get_state_srv_.reset();
+  tf_listener_.reset();
+  tf_buffer_.reset();
+  tfstatic_broadcaster_.reset();
+  // The next broadcaster has latched nothing yet
+  published_fix_transforms_.clear();
+  tf_pub_.reset();
+  pose_estimated_pub_.reset();
+  twist_estimated_pub_.reset();
+  pose_covariance_pub_.reset();
+  twist_covariance_pub_.reset();
+  diagnostics_pub_.reset();
+  snapshot_.close();
+}
 
 using CallbackReturn = rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::CallbackReturn;
 
@@ -358,15 +2347,21 @@ CallbackReturn BasicStateEstimator::on_configure(const rclcpp_lifecycle::State &
 
 CallbackReturn BasicStateEstimator::on_activate(const rclcpp_lifecycle::State &_state)
 {
-  // Set parameters?
-  setupTfTree();
+  activateNode();
 
   return CallbackReturn::SUCCESS;
 };
 
 CallbackReturn BasicStateEstimator::on_deactivate(const rclcpp_lifecycle::State &_state)
 {
-  // Clean up subscriptions, publishers, services, actions, etc. here.
+  // Resources are kept for a fast activation, released on cleanup
+  deactivateNode();
+
+  return CallbackReturn::SUCCESS;
+};
+
+CallbackReturn BasicStateEstimator::on_cleanup(const rclcpp_lifecycle::State &_state)
+{
   cleanupNode();
 
   return CallbackReturn::SUCCESS;
@@ -374,7 +2369,12 @@ CallbackReturn BasicStateEstimator::on_deactivate(const rclcpp_lifecycle::State
 
 CallbackReturn BasicStateEstimator::on_shutdown(const rclcpp_lifecycle::State &_state)
 {
-  // Clean other resources here.
+  // Shutdown may come from any state
+  if (active_)
+  {
+    deactivateNode();
+  }
+  cleanupNode();
 
   return CallbackReturn::SUCCESS;
 };
@@ -0,0 +1,112 @@
+/*!*******************************************************************************************
+ *  \file       basic_state_estimator_host.cpp
+ *  \brief      Process hosting the basic state estimators of several drones
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "basic_state_estimator.hpp"
+#include "swarm_kernel.hpp"
+#include "tf_batch.hpp"
+
+int main(int argc, char *argv[])
+{
+  rclcpp::init(argc, argv);
+  auto host = std::make_shared<rclcpp::Node>("basic_state_estimator_host");
+  const std::vector<std::string> drone_ids =
+      host->declare_parameter<std::vector<std::string>>("drone_ids", {"drone0"});
+  const double frequency = host->declare_parameter<double>("frequency", 100.0);
+  const bool batched = host->declare_parameter<bool>("batched", true);
+
+  // One participant, one executor and one pair of tf broadcasters for every drone
+  auto tf_batch = std::make_shared<basic_state_estimator::TfBatch>(2 * drone_ids.size());
+  tf2_ros::TransformBroadcaster tf_broadcaster(*host);
+  tf2_ros::StaticTransformBroadcaster tfstatic_broadcaster(host);
+  rclcpp::executors::SingleThreadedExecutor executor;
+  executor.add_node(host->get_node_base_interface());
+
+  std::vector<std::shared_ptr<BasicStateEstimator>> estimators;
+  estimators.reserve(drone_ids.size());
+  for (const std::string &drone_id : drone_ids)
+  {
+    rclcpp::NodeOptions options;
+    options.arguments({"--ros-args", "-r", "__ns:=/" + drone_id});
+    auto estimator = std::make_shared<BasicStateEstimator>(options);
+    estimator->setTfBatch(tf_batch);
+    estimator->configure();
+    estimator->activate();
+    executor.add_node(estimator->get_node_base_interface());
+    estimators.emplace_back(estimator);
+  }
+  RCLCPP_INFO(host->get_logger(), "HOSTING %zu ESTIMATORS%s", estimators.size(),
+              batched ? ", BATCHED" : "");
+
+  basic_state_estimator::SwarmKernel kernel(estimators.size());
+  std::vector<char> in_batch(estimators.size(), 0);
+
+  // Every cycle runs each estimator and sends all their transforms in one /tf message. Batched,
+  // the estimators only convert messages and the drone math runs once for the whole swarm.
+  auto run_timer =
+      host->create_wall_timer(std::chrono::duration<double>(1.0 / frequency), [&]() {
+        for (std::size_t i = 0; i < estimators.size(); i++)
+        {
+          in_batch[i] = batched && estimators[i]->gatherBatch(kernel, i);
+          if (!in_batch[i])
+          {
+            estimators[i]->run();
+          }
+        }
+        if (batched)
+        {
+          kernel.update();
+          for (std::size_t i = 0; i < estimators.size(); i++)
+          {
+            if (in_batch[i])
+            {
+              estimators[i]->scatterBatch(kernel, i);
+            }
+          }
+        }
+        tf_batch->flush(tf_broadcaster, tfstatic_broadcaster);
+      });
+  // Static transforms published while configuring
+  tf_batch->flush(tf_broadcaster, tfstatic_broadcaster);
+
+  executor.spin();
+  rclcpp::shutdown();
+  return 0;
+}
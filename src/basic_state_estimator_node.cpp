@@ -42,7 +42,34 @@ int main(int argc, char *argv[])
   rclcpp::init(argc, argv);
   auto node = std::make_shared<BasicStateEstimator>();
   node->preset_loop_frequency(100); // Node frequency for run and callbacks
-  as2::spinLoop(node, std::bind(&BasicStateEstimator::run, node));
+  const bool publish_on_input = node->get_parameter("publish_on_input").as_bool();
+  const int64_t executor_threads = node->get_parameter("executor_threads").as_int();
+  const bool realtime = node->get_parameter("realtime").as_bool();
+  if (realtime || publish_on_input || executor_threads > 1)
+  {
+    // Callbacks are served as soon as they arrive, each callback group on its own thread if
+    // executor_threads allows it. run() is driven by the real-time loop thread if enabled,
+    // otherwise by a timer as in spinLoop.
+    node->configure();
+    node->activate();
+    if (realtime)
+    {
+      node->startRealtimeLoop(100);
+    }
+    else
+    {
+      node->startRunTimer(100);
+    }
+    const std::size_t threads = static_cast<std::size_t>(std::max<int64_t>(executor_threads, 1));
+    rclcpp::executors::MultiThreadedExecutor executor(rclcpp::ExecutorOptions(), threads);
+    executor.add_node(node->get_node_base_interface());
+    executor.spin();
+    node->stopRealtimeLoop();
+  }
+  else
+  {
+    as2::spinLoop(node, std::bind(&BasicStateEstimator::run, node));
+  }
   rclcpp::shutdown();
   return 0;
 }
@@ -0,0 +1,435 @@
+/*!*******************************************************************************************
+ *  \file       basic_state_estimator_replay.cpp
+ *  \brief      Offline replay of a recorded bag through the estimation core
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+
+#include <geometry_msgs/msg/pose_stamped.hpp>
+#include <geometry_msgs/msg/twist_stamped.hpp>
+#include <nav_msgs/msg/odometry.hpp>
+#include <rclcpp/serialization.hpp>
+#include <rclcpp/serialized_message.hpp>
+#include <rosbag2_cpp/reader.hpp>
+#include <rosbag2_storage/storage_filter.hpp>
+#include <sensor_msgs/msg/imu.hpp>
+
+#include "as2_core/names/topics.hpp"
+#include "estimation_modes.hpp"
+#include "estimator_core.hpp"
+#include "fusion_inputs.hpp"
+#include "imu_propagator.hpp"
+#include "lag_compensated_filter.hpp"
+#include "state_history.hpp"
+
+namespace
+{
+
+using basic_state_estimator::GroundTruthMode;
+using basic_state_estimator::OdomOnlyMode;
+using basic_state_estimator::SensorFusionMode;
+
+struct ReplayOptions
+{
+  std::string bag;
+  std::string mode = "odom_only";
+  std::string ns = "/drone0";
+  bool imu_propagation = false;
+  std::string output;
+};
+
+void printUsage(const char *_program)
+{
+  std::printf("Usage: %s <bag> [--mode odom_only|ground_truth|sensor_fusion] [--namespace "
+              "/drone0]\n          [--imu-propagation] [--output estimates.csv]\n",
+              _program);
+}
+
+bool parseArguments(const int _argc, char **_argv, ReplayOptions &_options)
+{
+  for (int i = 1; i < _argc; i++)
+  {
+    const std::string argument = _argv[i];
+    const bool has_value = i + 1 < _argc;
+    if (argument == "--mode" && has_value)
+    {
+      _options.mode = _argv[++i];
+    }
+    else if (argument == "--namespace" && has_value)
+    {
+      _options.ns = _argv[++i];
+    }
+    else if (argument == "--output" && has_value)
+    {
+      _options.output = _argv[++i];
+    }
+    else if (argument == "--imu-propagation")
+    {
+      _options.imu_propagation = true;
+    }
+    else if (_options.bag.empty() && argument.rfind("--", 0) != 0)
+    {
+      _options.bag = argument;
+    }
+    else
+    {
+      return false;
+    }
+  }
+  return !_options.bag.empty() && (_options.mode == "odom_only" ||
+                                   _options.mode == "ground_truth" ||
+                                   _options.mode == "sensor_fusion");
+}
+
+int64_t toNanoseconds(const builtin_interfaces::msg::Time &_stamp)
+{
+  return static_cast<int64_t>(_stamp.sec) * 1000000000 + _stamp.nanosec;
+}
+
+int64_t threadCpuTime()
+{
+  timespec time;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+  return static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+/**
+ * @brief The BasicStateEstimator pipeline on the estimation core, without node, clock or
+ * executor: the same mode strategies, handover, drift, global state and fusion inputs, with the
+ * default parameters of the node. Every input is estimated as soon as it is read, as with
+ * publish_on_input, and the estimates carry the stamp of their input. With a ground truth in the
+ * bag, the estimated position is compared with it after aligning their first samples.
+ */
+class ReplayEstimator
+{
+public:
+  ReplayEstimator(const ReplayOptions &_options, std::ostream *_output)
+      : odom_only_(_options.mode == "odom_only"), ground_truth_(_options.mode == "ground_truth"),
+        sensor_fusion_(_options.mode == "sensor_fusion"),
+        imu_propagation_(odom_only_ && _options.imu_propagation), output_(_output),
+        filter_(basic_state_estimator::makeFusionFilter(fusion_parameters_))
+  {
+    if (output_)
+    {
+      *output_ << "stamp,x,y,z,qx,qy,qz,qw,vx,vy,vz\n";
+    }
+  }
+
+  void odometry(const nav_msgs::msg::Odometry &_msg)
+  {
+    const int64_t stamp = toNanoseconds(_msg.header.stamp);
+    const basic_state_estimator::Pose pose = basic_state_estimator::fromMsg(_msg.pose.pose);
+    const Eigen::Vector3d body_velocity = basic_state_estimator::fromMsg(_msg.twist.twist.linear);
+    if (imu_propagation_)
+    {
+      propagator_.reset(stamp, pose.position, pose.orientation, pose.orientation * body_velocity,
+                        basic_state_estimator::fromMsg(_msg.twist.twist.angular));
+      estimatePropagated();
+    }
+    else if (odom_only_)
+    {
+      odom2baselink_ = pose;
+      estimate<OdomOnlyMode>(stamp, odom2baselink_, body_velocity);
+    }
+    else if (sensor_fusion_)
+    {
+      odom2baselink_ = pose;
+      if (basic_state_estimator::fuseOdometry(
+              filter_, fusion_parameters_, stamp, 0, map2odom_, odom2baselink_, body_velocity,
+              basic_state_estimator::fromMsg(_msg.twist.twist.angular),
+              basic_state_estimator::covarianceFromMsg(_msg.pose.covariance),
+              basic_state_estimator::covarianceFromMsg(_msg.twist.covariance)))
+      {
+        estimateFusion();
+      }
+    }
+  }
+
+  void groundTruthPose(const geometry_msgs::msg::PoseStamped &_msg)
+  {
+    const int64_t stamp = toNanoseconds(_msg.header.stamp);
+    const basic_state_estimator::Pose pose = basic_state_estimator::fromMsg(_msg.pose);
+    basic_state_estimator::StateSample sample;
+    sample.stamp = stamp;
+    sample.position = pose.position;
+    ground_truth_history_.push(sample);
+
+    if (ground_truth_)
+    {
+      // Ground truth is sent as odom -> base_link
+      odom2baselink_ = pose;
+      estimate<GroundTruthMode>(stamp, odom2baselink_, gt_velocity_);
+    }
+    else if (sensor_fusion_ &&
+             basic_state_estimator::fuseAbsolutePose(filter_, fusion_parameters_, stamp, pose))
+    {
+      estimateFusion();
+    }
+  }
+
+  void groundTruthTwist(const geometry_msgs::msg::TwistStamped &_msg)
+  {
+    gt_velocity_ = basic_state_estimator::fromMsg(_msg.twist.linear);
+  }
+
+  void imu(const sensor_msgs::msg::Imu &_msg)
+  {
+    const int64_t stamp = toNanoseconds(_msg.header.stamp);
+    const Eigen::Vector3d acc = basic_state_estimator::fromMsg(_msg.linear_acceleration);
+    const Eigen::Vector3d gyro = basic_state_estimator::fromMsg(_msg.angular_velocity);
+    if (imu_propagation_ && propagator_.addImu(stamp, acc, gyro))
+    {
+      estimatePropagated();
+    }
+    else if (sensor_fusion_ && filter_.addImu(stamp, acc, gyro))
+    {
+      estimateFusion();
+    }
+  }
+
+  std::size_t estimates() const { return estimates_; }
+
+  bool positionRmse(double &_rmse) const
+  {
+    if (error_samples_ == 0)
+    {
+      return false;
+    }
+    _rmse = std::sqrt(squared_error_ / static_cast<double>(error_samples_));
+    return true;
+  }
+
+private:
+  const bool odom_only_;
+  const bool ground_truth_;
+  const bool sensor_fusion_;
+  const bool imu_propagation_;
+  std::ostream *output_;
+
+  basic_state_estimator::EstimatorCore core_;
+  basic_state_estimator::ImuPropagator propagator_;
+  const basic_state_estimator::FusionParameters fusion_parameters_;
+  basic_state_estimator::LagCompensatedFilter filter_;
+  basic_state_estimator::Pose odom2baselink_;
+  basic_state_estimator::Pose map2odom_;
+  Eigen::Vector3d gt_velocity_ = Eigen::Vector3d::Zero();
+
+  basic_state_estimator::StateHistory ground_truth_history_;
+  bool aligned_ = false;
+  Eigen::Vector3d alignment_ = Eigen::Vector3d::Zero();
+  double squared_error_ = 0.0;
+  std::size_t error_samples_ = 0;
+  std::size_t estimates_ = 0;
+
+  void estimatePropagated()
+  {
+    const basic_state_estimator::PropagatedState &state = propagator_.state();
+    odom2baselink_.position = state.position;
+    odom2baselink_.orientation = state.orientation;
+    estimate<OdomOnlyMode>(state.stamp, odom2baselink_,
+                           state.orientation.conjugate() * state.velocity);
+  }
+
+  void estimateFusion()
+  {
+    const basic_state_estimator::ErrorStateEkf &ekf = filter_.filter();
+    basic_state_estimator::Pose map2baselink;
+    map2baselink.position = ekf.position();
+    map2baselink.orientation = ekf.orientation();
+    estimate<SensorFusionMode>(filter_.stamp(), map2baselink, ekf.velocity());
+  }
+
+  // Same stages as BasicStateEstimator::estimatePipeline, every input is a new sample
+  template <typename ModeT>
+  void estimate(const int64_t _stamp, const basic_state_estimator::Pose &_source2baselink,
+                const Eigen::Vector3d &_velocity)
+  {
+    const basic_state_estimator::Pose &map2baselink =
+        core_.localize<ModeT>(_source2baselink, true);
+    map2odom_ = basic_state_estimator::driftBetween(odom2baselink_, map2baselink);
+    const basic_state_estimator::Pose pose = core_.globalPose(map2odom_, odom2baselink_);
+    const Eigen::Vector3d velocity = core_.globalVelocity<ModeT>(pose, _velocity);
+    estimates_++;
+    compareWithGroundTruth(_stamp, pose);
+
+    if (output_)
+    {
+      char row[256];
+      std::snprintf(row, sizeof(row), "%ld,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f\n",
+                    static_cast<long>(_stamp), pose.position.x(), pose.position.y(),
+                    pose.position.z(), pose.orientation.x(), pose.orientation.y(),
+                    pose.orientation.z(), pose.orientation.w(), velocity.x(), velocity.y(),
+                    velocity.z());
+      *output_ << row;
+    }
+  }
+
+  void compareWithGroundTruth(const int64_t _stamp, const basic_state_estimator::Pose &_pose)
+  {
+    basic_state_estimator::StateSample truth;
+    if (ground_truth_ || !ground_truth_history_.lookup(_stamp, truth))
+    {
+      return;
+    }
+    const Eigen::Vector3d &position = _pose.position;
+    if (!aligned_)
+    {
+      alignment_ = truth.position - position;
+      aligned_ = true;
+    }
+    squared_error_ += (position + alignment_ - truth.position).squaredNorm();
+    error_samples_++;
+  }
+};
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  ReplayOptions options;
+  if (!parseArguments(argc, argv, options))
+  {
+    printUsage(argv[0]);
+    return 1;
+  }
+  std::ofstream output;
+  if (!options.output.empty())
+  {
+    output.open(options.output);
+    if (!output)
+    {
+      std::fprintf(stderr, "Can not write %s\n", options.output.c_str());
+      return 1;
+    }
+  }
+
+  const std::string prefix = options.ns + "/";
+  const std::string odom_topic = prefix + as2_names::topics::sensor_measurements::odom;
+  const std::string imu_topic = prefix + as2_names::topics::sensor_measurements::imu;
+  const std::string gt_pose_topic = prefix + as2_names::topics::ground_truth::pose;
+  const std::string gt_twist_topic = prefix + as2_names::topics::ground_truth::twist;
+
+  rosbag2_cpp::Reader reader;
+  reader.open(options.bag);
+  rosbag2_storage::StorageFilter filter;
+  filter.topics = {odom_topic, imu_topic, gt_pose_topic, gt_twist_topic};
+  reader.set_filter(filter);
+
+  ReplayEstimator estimator(options, output.is_open() ? &output : nullptr);
+  rclcpp::Serialization<nav_msgs::msg::Odometry> odom_serialization;
+  rclcpp::Serialization<sensor_msgs::msg::Imu> imu_serialization;
+  rclcpp::Serialization<geometry_msgs::msg::PoseStamped> pose_serialization;
+  rclcpp::Serialization<geometry_msgs::msg::TwistStamped> twist_serialization;
+  nav_msgs::msg::Odometry odom;
+  sensor_msgs::msg::Imu imu;
+  geometry_msgs::msg::PoseStamped gt_pose;
+  geometry_msgs::msg::TwistStamped gt_twist;
+
+  // Messages are processed sequentially as fast as they are read, the CPU time of each one
+  // covers its deserialization and estimation
+  std::size_t messages = 0;
+  int64_t cpu_total = 0;
+  int64_t cpu_max = 0;
+  int64_t first_record = 0;
+  int64_t last_record = 0;
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  while (reader.has_next())
+  {
+    const std::shared_ptr<rosbag2_storage::SerializedBagMessage> bag_message = reader.read_next();
+    const int64_t cpu_start = threadCpuTime();
+    const rclcpp::SerializedMessage serialized(*bag_message->serialized_data);
+    const std::string &topic = bag_message->topic_name;
+    if (topic == odom_topic)
+    {
+      odom_serialization.deserialize_message(&serialized, &odom);
+      estimator.odometry(odom);
+    }
+    else if (topic == imu_topic)
+    {
+      imu_serialization.deserialize_message(&serialized, &imu);
+      estimator.imu(imu);
+    }
+    else if (topic == gt_pose_topic)
+    {
+      pose_serialization.deserialize_message(&serialized, &gt_pose);
+      estimator.groundTruthPose(gt_pose);
+    }
+    else if (topic == gt_twist_topic)
+    {
+      twist_serialization.deserialize_message(&serialized, &gt_twist);
+      estimator.groundTruthTwist(gt_twist);
+    }
+    const int64_t cpu = threadCpuTime() - cpu_start;
+    cpu_total += cpu;
+    cpu_max = std::max(cpu_max, cpu);
+    if (messages == 0)
+    {
+      first_record = bag_message->time_stamp;
+    }
+    last_record = bag_message->time_stamp;
+    messages++;
+  }
+  const double wall =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  const double recorded = 1e-9 * static_cast<double>(last_record - first_record);
+
+  std::printf("mode: %s%s\n", options.mode.c_str(),
+              options.imu_propagation ? " (imu propagation)" : "");
+  std::printf("messages: %zu, estimates: %zu\n", messages, estimator.estimates());
+  std::printf("recorded: %.3f s, replayed: %.3f s (x%.1f)\n", recorded, wall,
+              wall > 0.0 ? recorded / wall : 0.0);
+  if (messages > 0)
+  {
+    std::printf("cpu per message: mean %.3f us, max %.3f us\n",
+                1e-3 * static_cast<double>(cpu_total) / static_cast<double>(messages),
+                1e-3 * static_cast<double>(cpu_max));
+  }
+  double rmse;
+  if (estimator.positionRmse(rmse))
+  {
+    std::printf("position rmse against ground truth: %.4f m\n", rmse);
+  }
+  return 0;
+}
@@ -0,0 +1,235 @@
+/*!*******************************************************************************************
+ *  \file       error_state_ekf.cpp
+ *  \brief      Error state EKF for the basic state estimator sensor fusion mode
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "error_state_ekf.hpp"
+
+#include <cmath>
+
+namespace basic_state_estimator
+{
+
+ErrorStateEkf::ErrorStateEkf() : initialized_(false), gravity_(0.0, 0.0, -9.81)
+{
+  reset(Eigen::Vector3d::Zero(), Eigen::Quaterniond::Identity());
+  initialized_ = false;
+}
+
+void ErrorStateEkf::reset(const Eigen::Vector3d &_position, const Eigen::Quaterniond &_orientation,
+                          const Eigen::Vector3d &_velocity)
+{
+  position_ = _position;
+  velocity_ = _velocity;
+  orientation_ = _orientation.normalized();
+  acc_bias_.setZero();
+  gyro_bias_.setZero();
+  angular_velocity_.setZero();
+
+  covariance_.setZero();
+  covariance_.diagonal().segment<3>(POSITION).setConstant(1.0);
+  covariance_.diagonal().segment<3>(VELOCITY).setConstant(1.0);
+  covariance_.diagonal().segment<3>(ORIENTATION).setConstant(0.1);
+  covariance_.diagonal().segment<3>(ACC_BIAS).setConstant(0.01);
+  covariance_.diagonal().segment<3>(GYRO_BIAS).setConstant(0.001);
+  initialized_ = true;
+}
+
+void ErrorStateEkf::predict(const Eigen::Vector3d &_acc, const Eigen::Vector3d &_gyro,
+                            const double _dt)
+{
+  if (!initialized_ || _dt <= 0.0)
+  {
+    return;
+  }
+  const Eigen::Matrix3d R = orientation_.toRotationMatrix();
+  const Eigen::Vector3d acc = _acc - acc_bias_;
+  angular_velocity_ = _gyro - gyro_bias_;
+  const Eigen::Vector3d world_acc = R * acc + gravity_;
+
+  // Nominal state
+  position_ += velocity_ * _dt + 0.5 * world_acc * _dt * _dt;
+  velocity_ += world_acc * _dt;
+  orientation_ = (orientation_ * expMap(angular_velocity_ * _dt)).normalized();
+
+  // Error state transition
+  CovarianceMatrix F = CovarianceMatrix::Identity();
+  F.block<3, 3>(POSITION, VELOCITY) = Eigen::Matrix3d::Identity() * _dt;
+  F.block<3, 3>(VELOCITY, ORIENTATION) = -R * skew(acc) * _dt;
+  F.block<3, 3>(VELOCITY, ACC_BIAS) = -R * _dt;
+  F.block<3, 3>(ORIENTATION, ORIENTATION) =
+      expMap(angular_velocity_ * _dt).toRotationMatrix().transpose();
+  F.block<3, 3>(ORIENTATION, GYRO_BIAS) = -Eigen::Matrix3d::Identity() * _dt;
+
+  covariance_ = F * covariance_ * F.transpose();
+  addProcessNoise(_dt);
+}
+
+void ErrorStateEkf::predict(const double _dt, const Eigen::Vector3d &_angular_velocity)
+{
+  if (!initialized_ || _dt <= 0.0)
+  {
+    return;
+  }
+  // Constant velocity in the body frame, which turns with the angular velocity
+  const Eigen::Quaterniond rotation = expMap(_angular_velocity * _dt);
+  const Eigen::Matrix3d map_rotation =
+      (orientation_ * rotation * orientation_.conjugate()).toRotationMatrix();
+  position_ += velocity_ * _dt;
+  velocity_ = map_rotation * velocity_;
+  orientation_ = (orientation_ * rotation).normalized();
+
+  CovarianceMatrix F = CovarianceMatrix::Identity();
+  F.block<3, 3>(POSITION, VELOCITY) = Eigen::Matrix3d::Identity() * _dt;
+  F.block<3, 3>(VELOCITY, VELOCITY) = map_rotation;
+  F.block<3, 3>(ORIENTATION, ORIENTATION) = rotation.toRotationMatrix().transpose();
+  covariance_ = F * covariance_ * F.transpose();
+  // Unknown acceleration and angular velocity changes are taken as the same noise as the IMU's
+  addProcessNoise(_dt);
+}
+
+void ErrorStateEkf::updatePose(const Eigen::Vector3d &_position,
+                               const Eigen::Quaterniond &_orientation,
+                               const Matrix6d &_covariance)
+{
+  if (!initialized_)
+  {
+    reset(_position, _orientation);
+    return;
+  }
+  Eigen::Matrix<double, 6, 1> residual;
+  residual.head<3>() = _position - position_;
+  residual.tail<3>() = logMap(orientation_.conjugate() * _orientation);
+
+  Eigen::Matrix<double, 6, StateSize> H = Eigen::Matrix<double, 6, StateSize>::Zero();
+  H.block<3, 3>(0, POSITION).setIdentity();
+  H.block<3, 3>(3, ORIENTATION).setIdentity();
+
+  // Orientation covariance from the map axes to the body axes of the error state
+  const Eigen::Matrix3d Rt = orientation_.toRotationMatrix().transpose();
+  Matrix6d R = _covariance;
+  R.block<3, 3>(3, 3) = Rt * _covariance.block<3, 3>(3, 3) * Rt.transpose();
+  R.block<3, 3>(0, 3) = _covariance.block<3, 3>(0, 3) * Rt.transpose();
+  R.block<3, 3>(3, 0) = R.block<3, 3>(0, 3).transpose();
+  update<6>(residual, H, R);
+}
+
+void ErrorStateEkf::updatePosition(const Eigen::Vector3d &_position,
+                                   const Eigen::Matrix3d &_covariance)
+{
+  if (!initialized_)
+  {
+    reset(_position, Eigen::Quaterniond::Identity());
+    return;
+  }
+  Eigen::Matrix<double, 3, StateSize> H = Eigen::Matrix<double, 3, StateSize>::Zero();
+  H.block<3, 3>(0, POSITION).setIdentity();
+  update<3>(_position - position_, H, _covariance);
+}
+
+void ErrorStateEkf::updateBodyVelocity(const Eigen::Vector3d &_velocity,
+                                       const Eigen::Matrix3d &_covariance)
+{
+  if (!initialized_)
+  {
+    return;
+  }
+  // h(x) = R^T * v, with R = R_nominal * Exp(dtheta)
+  const Eigen::Matrix3d Rt = orientation_.toRotationMatrix().transpose();
+  const Eigen::Vector3d expected = Rt * velocity_;
+
+  Eigen::Matrix<double, 3, StateSize> H = Eigen::Matrix<double, 3, StateSize>::Zero();
+  H.block<3, 3>(0, VELOCITY) = Rt;
+  H.block<3, 3>(0, ORIENTATION) = skew(expected);
+  update<3>(_velocity - expected, H, _covariance);
+}
+
+void ErrorStateEkf::addProcessNoise(const double _dt)
+{
+  // White noise acceleration integrated into position and velocity, so a step of _dt adds the
+  // same covariance as two steps of _dt / 2 whatever the input rate
+  const double acc_variance = noise_.acc_noise * noise_.acc_noise;
+  const double dt2 = _dt * _dt;
+  covariance_.block<3, 3>(POSITION, POSITION).diagonal().array() += acc_variance * dt2 * _dt / 3.0;
+  covariance_.block<3, 3>(POSITION, VELOCITY).diagonal().array() += acc_variance * dt2 / 2.0;
+  covariance_.block<3, 3>(VELOCITY, POSITION).diagonal().array() += acc_variance * dt2 / 2.0;
+  covariance_.block<3, 3>(VELOCITY, VELOCITY).diagonal().array() += acc_variance * _dt;
+  covariance_.diagonal().segment<3>(ORIENTATION).array() +=
+      noise_.gyro_noise * noise_.gyro_noise * _dt;
+  covariance_.diagonal().segment<3>(ACC_BIAS).array() +=
+      noise_.acc_bias_noise * noise_.acc_bias_noise * _dt;
+  covariance_.diagonal().segment<3>(GYRO_BIAS).array() +=
+      noise_.gyro_bias_noise * noise_.gyro_bias_noise * _dt;
+}
+
+void ErrorStateEkf::injectErrorState(const ErrorState &_dx)
+{
+  position_ += _dx.segment<3>(POSITION);
+  velocity_ += _dx.segment<3>(VELOCITY);
+  orientation_ = (orientation_ * expMap(_dx.segment<3>(ORIENTATION))).normalized();
+  acc_bias_ += _dx.segment<3>(ACC_BIAS);
+  gyro_bias_ += _dx.segment<3>(GYRO_BIAS);
+}
+
+Eigen::Matrix3d ErrorStateEkf::skew(const Eigen::Vector3d &_v)
+{
+  Eigen::Matrix3d m;
+  m << 0.0, -_v.z(), _v.y(), _v.z(), 0.0, -_v.x(), -_v.y(), _v.x(), 0.0;
+  return m;
+}
+
+Eigen::Quaterniond ErrorStateEkf::expMap(const Eigen::Vector3d &_rotation)
+{
+  const double angle = _rotation.norm();
+  if (angle < 1e-9)
+  {
+    return Eigen::Quaterniond(1.0, 0.5 * _rotation.x(), 0.5 * _rotation.y(), 0.5 * _rotation.z())
+        .normalized();
+  }
+  return Eigen::Quaterniond(Eigen::AngleAxisd(angle, _rotation / angle));
+}
+
+Eigen::Vector3d ErrorStateEkf::logMap(const Eigen::Quaterniond &_q)
+{
+  // Shortest rotation
+  const Eigen::Quaterniond q = _q.w() < 0.0 ? Eigen::Quaterniond(-_q.coeffs()) : _q;
+  const double vec_norm = q.vec().norm();
+  if (vec_norm < 1e-9)
+  {
+    return 2.0 * q.vec();
+  }
+  return 2.0 * std::atan2(vec_norm, q.w()) * q.vec() / vec_norm;
+}
+
+} // namespace basic_state_estimator
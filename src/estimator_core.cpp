@@ -0,0 +1,92 @@
+/*!*******************************************************************************************
+ *  \file       estimator_core.cpp
+ *  \brief      Estimation math of the basic state estimator, independent of the node
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "estimator_core.hpp"
+
+namespace basic_state_estimator
+{
+
+Pose driftBetween(const Pose &_odom2baselink, const Pose &_map2baselink)
+{
+  return compose(_map2baselink, inverse(_odom2baselink));
+}
+
+void EstimatorCore::reset()
+{
+  mode_offset_active_ = false;
+  handover_pending_ = false;
+  map2baselink_valid_ = false;
+}
+
+void EstimatorCore::beginHandover()
+{
+  mode_offset_active_ = false;
+  handover_pending_ = map2baselink_valid_;
+}
+
+void EstimatorCore::restore(const Pose &_map2baselink, const Pose &_mode_offset,
+                            const bool _offset_active)
+{
+  last_map2baselink_ = _map2baselink;
+  map2baselink_valid_ = true;
+  handover_pending_ = false;
+  mode_offset_ = _mode_offset;
+  mode_offset_active_ = _offset_active;
+}
+
+const Pose &EstimatorCore::localize(const Pose &_source2baselink, const bool _offset_on_switch,
+                                    const bool _new_sample)
+{
+  if (_offset_on_switch && handover_pending_)
+  {
+    if (!_new_sample)
+    {
+      // Nothing from the source switched to yet, hold the last estimate
+      return last_map2baselink_;
+    }
+    // First sample of the source switched to
+    mode_offset_ = driftBetween(_source2baselink, last_map2baselink_);
+    mode_offset_active_ = true;
+    handover_pending_ = false;
+  }
+  last_map2baselink_ = _offset_on_switch && mode_offset_active_
+                           ? compose(mode_offset_, _source2baselink)
+                           : _source2baselink;
+  map2baselink_valid_ = true;
+  return last_map2baselink_;
+}
+
+} // namespace basic_state_estimator
@@ -0,0 +1,107 @@
+/*!*******************************************************************************************
+ *  \file       fusion_inputs.cpp
+ *  \brief      Sensor fusion inputs of the basic state estimator
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "fusion_inputs.hpp"
+
+#include <algorithm>
+
+namespace basic_state_estimator
+{
+
+LagCompensatedFilter makeFusionFilter(const FusionParameters &_parameters)
+{
+  LagCompensatedFilter filter(std::max<std::size_t>(_parameters.replay_window, 2),
+                              _parameters.max_replay_depth);
+  filter.setNoiseParameters(_parameters.noise);
+  filter.setImuTimeout(static_cast<int64_t>(_parameters.imu_timeout * 1e9));
+  return filter;
+}
+
+void applyMinimumStd(Matrix6d &_covariance, const double _position_std,
+                     const double _orientation_std)
+{
+  for (int i = 0; i < 3; i++)
+  {
+    _covariance(i, i) = std::max(_covariance(i, i), _position_std * _position_std);
+    _covariance(i + 3, i + 3) =
+        std::max(_covariance(i + 3, i + 3), _orientation_std * _orientation_std);
+  }
+}
+
+bool fuseOdometry(LagCompensatedFilter &_filter, const FusionParameters &_parameters,
+                  const int64_t _stamp, const std::size_t _source, const Pose &_map2odom,
+                  const Pose &_odom2baselink, const Eigen::Vector3d &_body_velocity,
+                  const Eigen::Vector3d &_body_angular_velocity, const Matrix6d &_pose_covariance,
+                  const Matrix6d &_twist_covariance)
+{
+  Matrix6d pose_covariance = _pose_covariance;
+  applyMinimumStd(pose_covariance, _parameters.odom_position_std,
+                  _parameters.odom_orientation_std);
+  Eigen::Matrix3d velocity_covariance = _twist_covariance.block<3, 3>(0, 0);
+  for (int i = 0; i < 3; i++)
+  {
+    velocity_covariance(i, i) = std::max(
+        velocity_covariance(i, i), _parameters.odom_velocity_std * _parameters.odom_velocity_std);
+  }
+
+  if (!_filter.isInitialized())
+  {
+    const Pose map2baselink = compose(_map2odom, _odom2baselink);
+    _filter.initialize(_stamp, map2baselink.position, map2baselink.orientation,
+                       map2baselink.orientation * _body_velocity);
+  }
+  // On the first sample this anchors the increments at the initial state
+  return _filter.addOdometry(_stamp, _source, _odom2baselink.position,
+                             _odom2baselink.orientation, pose_covariance, _body_velocity,
+                             velocity_covariance, _body_angular_velocity);
+}
+
+bool fuseAbsolutePose(LagCompensatedFilter &_filter, const FusionParameters &_parameters,
+                      const int64_t _stamp, const Pose &_map2baselink)
+{
+  Matrix6d pose_covariance = Matrix6d::Zero();
+  applyMinimumStd(pose_covariance, _parameters.pose_position_std,
+                  _parameters.pose_orientation_std);
+  if (!_filter.isInitialized())
+  {
+    _filter.initialize(_stamp, _map2baselink.position, _map2baselink.orientation);
+    return true;
+  }
+  return _filter.addPose(_stamp, _map2baselink.position, _map2baselink.orientation,
+                         pose_covariance);
+}
+
+} // namespace basic_state_estimator
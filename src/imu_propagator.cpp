@@ -0,0 +1,157 @@
+/*!*******************************************************************************************
+ *  \file       imu_propagator.cpp
+ *  \brief      IMU preintegration between odometry samples
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "imu_propagator.hpp"
+
+namespace basic_state_estimator
+{
+
+namespace
+{
+
+const Eigen::Vector3d gravity(0.0, 0.0, -9.81);
+
+Eigen::Quaterniond expMap(const Eigen::Vector3d &_rotation)
+{
+  const double angle = _rotation.norm();
+  if (angle < 1e-12)
+  {
+    return Eigen::Quaterniond(1.0, 0.5 * _rotation.x(), 0.5 * _rotation.y(), 0.5 * _rotation.z())
+        .normalized();
+  }
+  return Eigen::Quaterniond(Eigen::AngleAxisd(angle, _rotation / angle));
+}
+
+} // namespace
+
+ImuPropagator::ImuPropagator(const std::size_t _buffer_size) : samples_(_buffer_size) {}
+
+void ImuPropagator::clear()
+{
+  first_ = size_ = 0;
+  anchored_ = false;
+  integrated_samples_ = 0;
+}
+
+void ImuPropagator::reset(const int64_t _stamp, const Eigen::Vector3d &_position,
+                          const Eigen::Quaterniond &_orientation, const Eigen::Vector3d &_velocity,
+                          const Eigen::Vector3d &_angular_velocity)
+{
+  anchor_.stamp = _stamp;
+  anchor_.position = _position;
+  anchor_.orientation = _orientation.normalized();
+  anchor_.velocity = _velocity;
+  anchor_.angular_velocity = _angular_velocity;
+  anchored_ = true;
+  preintegration_ = Preintegration();
+  last_integrated_stamp_ = _stamp;
+  integrated_samples_ = 0;
+  state_ = anchor_;
+
+  // Samples up to the anchor are already accounted for by the odometry
+  while (size_ > 0 && at(0).stamp <= _stamp)
+  {
+    first_ = (first_ + 1) % samples_.size();
+    size_--;
+  }
+  for (std::size_t i = 0; i < size_ && integrate(at(i)); i++)
+  {
+  }
+  predict();
+}
+
+bool ImuPropagator::addImu(const int64_t _stamp, const Eigen::Vector3d &_linear_acceleration,
+                           const Eigen::Vector3d &_angular_velocity)
+{
+  if (samples_.empty() || (size_ > 0 && _stamp <= at(size_ - 1).stamp))
+  {
+    return false;
+  }
+  ImuSample *sample;
+  if (size_ < samples_.size())
+  {
+    sample = &samples_[(first_ + size_) % samples_.size()];
+    size_++;
+  }
+  else
+  {
+    // Odometry stopped, the oldest sample will not be integrated again
+    sample = &samples_[first_];
+    first_ = (first_ + 1) % samples_.size();
+  }
+  sample->stamp = _stamp;
+  sample->linear_acceleration = _linear_acceleration;
+  sample->angular_velocity = _angular_velocity;
+
+  if (!anchored_ || !integrate(*sample))
+  {
+    return false;
+  }
+  predict();
+  return true;
+}
+
+bool ImuPropagator::integrate(const ImuSample &_sample)
+{
+  if (_sample.stamp <= last_integrated_stamp_ || _sample.stamp - anchor_.stamp > max_horizon_)
+  {
+    return false;
+  }
+  const double dt = 1e-9 * static_cast<double>(_sample.stamp - last_integrated_stamp_);
+  Preintegration &pre = preintegration_;
+  const Eigen::Vector3d acc = pre.dq * _sample.linear_acceleration;
+  pre.dp += pre.dv * dt + 0.5 * acc * dt * dt;
+  pre.dv += acc * dt;
+  pre.dq = (pre.dq * expMap(_sample.angular_velocity * dt)).normalized();
+  pre.dt += dt;
+  state_.angular_velocity = _sample.angular_velocity;
+  last_integrated_stamp_ = _sample.stamp;
+  integrated_samples_++;
+  return true;
+}
+
+void ImuPropagator::predict()
+{
+  const Preintegration &pre = preintegration_;
+  const Eigen::Quaterniond &q0 = anchor_.orientation;
+  state_.stamp = last_integrated_stamp_;
+  state_.position = anchor_.position + anchor_.velocity * pre.dt +
+                    0.5 * gravity * pre.dt * pre.dt + q0 * pre.dp;
+  state_.velocity = anchor_.velocity + gravity * pre.dt + q0 * pre.dv;
+  state_.orientation = (q0 * pre.dq).normalized();
+}
+
+} // namespace basic_state_estimator
@@ -0,0 +1,265 @@
+/*!*******************************************************************************************
+ *  \file       lag_compensated_filter.cpp
+ *  \brief      Sensor fusion with bounded replay of delayed measurements
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "lag_compensated_filter.hpp"
+
+#include <algorithm>
+
+namespace basic_state_estimator
+{
+
+namespace
+{
+
+// Pose covariance with its position and orientation parts rotated to other axes
+ErrorStateEkf::Matrix6d rotatePoseCovariance(const ErrorStateEkf::Matrix6d &_covariance,
+                                             const Eigen::Matrix3d &_position_rotation,
+                                             const Eigen::Matrix3d &_orientation_rotation)
+{
+  ErrorStateEkf::Matrix6d rotation = ErrorStateEkf::Matrix6d::Zero();
+  rotation.block<3, 3>(0, 0) = _position_rotation;
+  rotation.block<3, 3>(3, 3) = _orientation_rotation;
+  return rotation * _covariance * rotation.transpose();
+}
+
+} // namespace
+
+LagCompensatedFilter::LagCompensatedFilter(const std::size_t _window,
+                                           const std::size_t _max_replay_depth)
+    : window_(std::max<std::size_t>(_window, 2)), first_(0), size_(0),
+      max_replay_depth_(std::min(_max_replay_depth, window_.size() - 1)),
+      imu_timeout_(100000000), replayed_inputs_(0), dropped_inputs_(0)
+{
+}
+
+void LagCompensatedFilter::clear()
+{
+  current_ = FilterState();
+  first_ = size_ = 0;
+}
+
+void LagCompensatedFilter::initialize(const int64_t _stamp, const Eigen::Vector3d &_position,
+                                      const Eigen::Quaterniond &_orientation,
+                                      const Eigen::Vector3d &_velocity)
+{
+  clear();
+  current_.ekf.setNoiseParameters(noise_);
+  current_.ekf.reset(_position, _orientation, _velocity);
+  current_.stamp = _stamp;
+}
+
+bool LagCompensatedFilter::addImu(const int64_t _stamp, const Eigen::Vector3d &_acc,
+                                  const Eigen::Vector3d &_gyro)
+{
+  input_.type = InputType::IMU;
+  input_.stamp = _stamp;
+  input_.vector_a = _acc;
+  input_.vector_b = _gyro;
+  return add(input_);
+}
+
+bool LagCompensatedFilter::addPose(const int64_t _stamp, const Eigen::Vector3d &_position,
+                                   const Eigen::Quaterniond &_orientation,
+                                   const ErrorStateEkf::Matrix6d &_covariance)
+{
+  input_.type = InputType::POSE;
+  input_.stamp = _stamp;
+  input_.vector_a = _position;
+  input_.orientation = _orientation;
+  input_.pose_covariance = _covariance;
+  return add(input_);
+}
+
+bool LagCompensatedFilter::addOdometry(const int64_t _stamp, const std::size_t _source,
+                                       const Eigen::Vector3d &_position,
+                                       const Eigen::Quaterniond &_orientation,
+                                       const ErrorStateEkf::Matrix6d &_pose_covariance,
+                                       const Eigen::Vector3d &_velocity,
+                                       const Eigen::Matrix3d &_velocity_covariance,
+                                       const Eigen::Vector3d &_angular_velocity)
+{
+  input_.type = InputType::ODOMETRY;
+  input_.stamp = _stamp;
+  input_.source = _source;
+  input_.vector_a = _position;
+  input_.vector_b = _velocity;
+  input_.orientation = _orientation;
+  input_.pose_covariance = _pose_covariance;
+  input_.velocity_covariance = _velocity_covariance;
+  input_.angular_velocity = _angular_velocity;
+  return add(input_);
+}
+
+bool LagCompensatedFilter::add(const Input &_input)
+{
+  if (!isInitialized())
+  {
+    return false;
+  }
+  if (max_replay_depth_ == 0)
+  {
+    apply(_input, current_);
+    return true;
+  }
+
+  // Insert after every input with a stamp not newer than this one, scanning back at most the
+  // replay depth
+  std::size_t position = size_;
+  while (position > 0 && at(position - 1).stamp > _input.stamp)
+  {
+    if (size_ - position == max_replay_depth_)
+    {
+      dropped_inputs_++;
+      return false;
+    }
+    position--;
+  }
+  if (position == 0 && size_ > 0)
+  {
+    // Older than the window, there is no state to restore
+    dropped_inputs_++;
+    return false;
+  }
+
+  // State before the new input, the initial state while the window is empty
+  FilterState state = position > 0 ? at(position - 1).state : current_;
+  if (size_ == window_.size())
+  {
+    first_ = (first_ + 1) % window_.size();
+    size_--;
+    position--;
+  }
+  for (std::size_t i = size_; i > position; i--)
+  {
+    at(i) = at(i - 1);
+  }
+  at(position) = _input;
+  size_++;
+
+  // Apply the new input and re-apply the suffix after it
+  for (std::size_t i = position; i < size_; i++)
+  {
+    apply(at(i), state);
+    at(i).state = state;
+  }
+  replayed_inputs_ += size_ - position - 1;
+  current_ = state;
+  return true;
+}
+
+void LagCompensatedFilter::apply(const Input &_input, FilterState &_state) const
+{
+  const bool imu_active = isImuActive(_state, _input.stamp);
+  const double dt = _input.stamp > _state.stamp ? (_input.stamp - _state.stamp) * 1e-9 : 0.0;
+
+  if (_input.type == InputType::IMU)
+  {
+    if (imu_active)
+    {
+      _state.ekf.predict(_input.vector_a, _input.vector_b, dt);
+    }
+    else
+    {
+      // Bridge the IMU gap with the constant velocity model
+      _state.ekf.predict(dt, _state.odom_angular_velocity);
+    }
+    _state.last_imu_stamp = _input.stamp;
+    _state.imu_received = true;
+    _state.imu_acc = _input.vector_a;
+    _state.imu_gyro = _input.vector_b;
+    _state.stamp = std::max(_state.stamp, _input.stamp);
+    return;
+  }
+
+  // Up to the measurement stamp with the last IMU sample held, or with the constant velocity
+  // model without IMU, so the update and the odometry anchor are at the measurement stamp
+  if (imu_active)
+  {
+    _state.ekf.predict(_state.imu_acc, _state.imu_gyro, dt);
+  }
+  else
+  {
+    _state.ekf.predict(dt, _state.odom_angular_velocity);
+  }
+  _state.stamp = std::max(_state.stamp, _input.stamp);
+  if (_input.type == InputType::ODOMETRY)
+  {
+    applyOdometry(_input, _state);
+    return;
+  }
+  _state.ekf.updatePose(_input.vector_a, _input.orientation, _input.pose_covariance);
+}
+
+void LagCompensatedFilter::applyOdometry(const Input &_input, FilterState &_state) const
+{
+  OdometryAnchor &anchor = _state.odometry_anchor;
+  if (anchor.valid && anchor.source == _input.source)
+  {
+    // map -> odom at the anchor stamp, both poses are from the same instant
+    const Eigen::Quaterniond drift = anchor.orientation * anchor.odom_orientation.conjugate();
+    const Eigen::Vector3d position =
+        anchor.position + drift * (_input.vector_a - anchor.odom_position);
+    const Eigen::Quaterniond orientation = drift * _input.orientation;
+    // The measurement carries the error of the anchor state, which the filter state shares, so
+    // its covariance is added instead of fusing the increment as independent
+    const Eigen::Matrix3d drift_rotation = drift.toRotationMatrix();
+    const ErrorStateEkf::Matrix6d covariance =
+        rotatePoseCovariance(_input.pose_covariance, drift_rotation, drift_rotation) +
+        anchor.covariance;
+    _state.ekf.updatePose(position, orientation, covariance);
+  }
+  _state.ekf.updateBodyVelocity(_input.vector_b, _input.velocity_covariance);
+  _state.odom_angular_velocity = _input.angular_velocity;
+
+  const ErrorStateEkf &ekf = _state.ekf;
+  anchor.valid = true;
+  anchor.source = _input.source;
+  anchor.odom_position = _input.vector_a;
+  anchor.odom_orientation = _input.orientation;
+  anchor.position = ekf.position();
+  anchor.orientation = ekf.orientation();
+  // The orientation error of the filter is in the body frame
+  const ErrorStateEkf::CovarianceMatrix &P = ekf.covariance();
+  ErrorStateEkf::Matrix6d pose_covariance;
+  pose_covariance << P.block<3, 3>(ErrorStateEkf::POSITION, ErrorStateEkf::POSITION),
+      P.block<3, 3>(ErrorStateEkf::POSITION, ErrorStateEkf::ORIENTATION),
+      P.block<3, 3>(ErrorStateEkf::ORIENTATION, ErrorStateEkf::POSITION),
+      P.block<3, 3>(ErrorStateEkf::ORIENTATION, ErrorStateEkf::ORIENTATION);
+  anchor.covariance = rotatePoseCovariance(pose_covariance, Eigen::Matrix3d::Identity(),
+                                           ekf.orientation().toRotationMatrix());
+}
+
+} // namespace basic_state_estimator
@@ -0,0 +1,95 @@
+/*!*******************************************************************************************
+ *  \file       message_reserve.cpp
+ *  \brief      Preallocated messages for the intra-process publishers
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "message_reserve.hpp"
+
+namespace basic_state_estimator
+{
+
+ReserveRefill::ReserveRefill(const std::chrono::milliseconds _period) : period_(_period) {}
+
+ReserveRefill::~ReserveRefill() { stop(); }
+
+void ReserveRefill::start(const std::vector<MessageReserveBase *> &_reserves)
+{
+  stop();
+  reserves_ = _reserves;
+  for (MessageReserveBase *reserve : reserves_)
+  {
+    reserve->refill_thread_ = this;
+    reserve->refill();
+  }
+  running_ = true;
+  thread_ = std::thread(&ReserveRefill::loop, this);
+}
+
+void ReserveRefill::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  wake_up_.notify_one();
+  if (thread_.joinable())
+  {
+    thread_.join();
+  }
+}
+
+void ReserveRefill::notify()
+{
+  pending_.store(true, std::memory_order_release);
+  wake_up_.notify_one();
+}
+
+void ReserveRefill::loop()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (running_.load(std::memory_order_relaxed))
+  {
+    wake_up_.wait_for(lock, period_, [this]() {
+      return pending_.load(std::memory_order_acquire) ||
+             !running_.load(std::memory_order_relaxed);
+    });
+    pending_.store(false, std::memory_order_relaxed);
+    for (MessageReserveBase *reserve : reserves_)
+    {
+      reserve->refill();
+    }
+  }
+}
+
+} // namespace basic_state_estimator
@@ -0,0 +1,196 @@
+/*!*******************************************************************************************
+ *  \file       realtime_loop.cpp
+ *  \brief      Real-time periodic loop thread for the estimation
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "realtime_loop.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include <cerrno>
+#include <cstring>
+#include <future>
+
+namespace basic_state_estimator
+{
+
+namespace
+{
+
+constexpr int64_t nanoseconds_per_second = 1000000000;
+
+void addNanoseconds(timespec &_time, const int64_t _ns)
+{
+  const int64_t total = _time.tv_nsec + _ns;
+  _time.tv_sec += total / nanoseconds_per_second;
+  _time.tv_nsec = total % nanoseconds_per_second;
+}
+
+int64_t nanosecondsBetween(const timespec &_from, const timespec &_to)
+{
+  return (_to.tv_sec - _from.tv_sec) * nanoseconds_per_second + (_to.tv_nsec - _from.tv_nsec);
+}
+
+void appendError(std::string &_errors, const char *_setting, const int _error)
+{
+  if (!_errors.empty())
+  {
+    _errors += ", ";
+  }
+  _errors += std::string(_setting) + ": " + std::strerror(_error);
+}
+
+// Touch the stack the loop may use so its pages are already locked at the first cycle
+void prefaultStack()
+{
+  constexpr std::size_t stack_size = 64 * 1024;
+  constexpr std::size_t page_size = 4096;
+  volatile unsigned char stack[stack_size];
+  for (std::size_t i = 0; i < stack_size; i += page_size)
+  {
+    stack[i] = 0;
+  }
+  static_cast<void>(stack[0]);
+}
+
+} // namespace
+
+RealtimeLoop::RealtimeLoop(const std::chrono::nanoseconds _period, std::function<void()> _cycle)
+    : period_(_period), cycle_(std::move(_cycle))
+{
+}
+
+RealtimeLoop::~RealtimeLoop() { stop(); }
+
+std::string RealtimeLoop::start(const RealtimeOptions &_options)
+{
+  if (running_.exchange(true))
+  {
+    return "";
+  }
+  std::string errors;
+  if (_options.lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+  {
+    appendError(errors, "mlockall", errno);
+  }
+  // The scheduling settings only apply to the calling thread, the loop thread sets its own
+  std::promise<std::string> thread_errors;
+  std::future<std::string> thread_errors_result = thread_errors.get_future();
+  thread_ = std::thread([this, _options, &thread_errors]() {
+    thread_errors.set_value(applyThreadOptions(_options));
+    loop();
+  });
+  const std::string loop_errors = thread_errors_result.get();
+  if (!loop_errors.empty())
+  {
+    errors += errors.empty() ? loop_errors : ", " + loop_errors;
+  }
+  return errors;
+}
+
+void RealtimeLoop::stop()
+{
+  running_ = false;
+  if (thread_.joinable())
+  {
+    thread_.join();
+  }
+}
+
+std::string RealtimeLoop::applyThreadOptions(const RealtimeOptions &_options)
+{
+  std::string errors;
+  if (_options.cpu >= 0)
+  {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(_options.cpu, &cpus);
+    const int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (error != 0)
+    {
+      appendError(errors, "CPU affinity", error);
+    }
+  }
+  if (_options.priority > 0)
+  {
+    sched_param parameters{};
+    parameters.sched_priority = _options.priority;
+    const int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters);
+    if (error != 0)
+    {
+      appendError(errors, "SCHED_FIFO", error);
+    }
+    realtime_ = error == 0;
+  }
+  if (_options.lock_memory)
+  {
+    prefaultStack();
+  }
+  return errors;
+}
+
+void RealtimeLoop::loop()
+{
+  timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  while (running_.load(std::memory_order_relaxed))
+  {
+    addNanoseconds(deadline, period_.count());
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR)
+    {
+    }
+    if (!running_.load(std::memory_order_relaxed))
+    {
+      break;
+    }
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    jitter_.add(nanosecondsBetween(deadline, now));
+
+    cycle_();
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (nanosecondsBetween(deadline, now) >= period_.count())
+    {
+      // The next deadline is already missed, restart the schedule from now
+      overruns_.fetch_add(1, std::memory_order_relaxed);
+      deadline = now;
+    }
+  }
+}
+
+} // namespace basic_state_estimator
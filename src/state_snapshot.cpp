@@ -0,0 +1,153 @@
+/*!*******************************************************************************************
+ *  \file       state_snapshot.cpp
+ *  \brief      Memory mapped snapshot of the estimation state for warm starts
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "state_snapshot.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+namespace basic_state_estimator
+{
+
+namespace
+{
+
+constexpr uint32_t snapshot_magic = 0x42534553; // "BSES"
+constexpr uint32_t snapshot_version = 1;
+
+// FNV-1a over the state bytes
+uint64_t checksum(const SnapshotState &_state)
+{
+  const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&_state);
+  uint64_t hash = 14695981039346656037ull;
+  for (std::size_t i = 0; i < sizeof(SnapshotState); i++)
+  {
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+} // namespace
+
+struct StateSnapshot::File
+{
+  uint32_t magic;
+  uint32_t version;
+  // Odd while a write is in progress
+  uint64_t sequence;
+  uint64_t checksum;
+  SnapshotState state;
+};
+
+StateSnapshot::~StateSnapshot() { close(); }
+
+std::string StateSnapshot::open(const std::string &_path)
+{
+  close();
+  fd_ = ::open(_path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd_ < 0)
+  {
+    return "open " + _path + ": " + std::strerror(errno);
+  }
+  // A shorter file is a missing or older snapshot, it is extended with zeros and rejected by read()
+  struct stat file_stat;
+  if (fstat(fd_, &file_stat) != 0 ||
+      (file_stat.st_size < static_cast<off_t>(sizeof(File)) && ftruncate(fd_, sizeof(File)) != 0))
+  {
+    const std::string error = "resize " + _path + ": " + std::strerror(errno);
+    close();
+    return error;
+  }
+  void *mapping = mmap(nullptr, sizeof(File), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (mapping == MAP_FAILED)
+  {
+    const std::string error = "mmap " + _path + ": " + std::strerror(errno);
+    close();
+    return error;
+  }
+  file_ = static_cast<File *>(mapping);
+  return "";
+}
+
+void StateSnapshot::close()
+{
+  if (file_ != nullptr)
+  {
+    msync(file_, sizeof(File), MS_SYNC);
+    munmap(file_, sizeof(File));
+    file_ = nullptr;
+  }
+  if (fd_ >= 0)
+  {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+void StateSnapshot::write(const SnapshotState &_state)
+{
+  if (file_ == nullptr)
+  {
+    return;
+  }
+  file_->sequence |= 1;
+  std::atomic_thread_fence(std::memory_order_release);
+  file_->magic = snapshot_magic;
+  file_->version = snapshot_version;
+  std::memcpy(&file_->state, &_state, sizeof(SnapshotState));
+  file_->checksum = checksum(_state);
+  std::atomic_thread_fence(std::memory_order_release);
+  file_->sequence++;
+}
+
+bool StateSnapshot::read(SnapshotState &_state) const
+{
+  if (file_ == nullptr || file_->magic != snapshot_magic || file_->version != snapshot_version ||
+      file_->sequence == 0 || (file_->sequence & 1) != 0)
+  {
+    return false;
+  }
+  std::memcpy(&_state, &file_->state, sizeof(SnapshotState));
+  return checksum(_state) == file_->checksum;
+}
+
+} // namespace basic_state_estimator
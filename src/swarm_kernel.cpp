@@ -0,0 +1,127 @@
+/*!*******************************************************************************************
+ *  \file       swarm_kernel.cpp
+ *  \brief      Structure of arrays estimation kernel for the multi-drone host
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "swarm_kernel.hpp"
+
+namespace basic_state_estimator
+{
+
+void VectorArrays::resize(const std::size_t _size)
+{
+  const Eigen::Index size = static_cast<Eigen::Index>(_size);
+  x.setZero(size);
+  y.setZero(size);
+  z.setZero(size);
+}
+
+void PoseArrays::resize(const std::size_t _size)
+{
+  const Eigen::Index size = static_cast<Eigen::Index>(_size);
+  x.setZero(size);
+  y.setZero(size);
+  z.setZero(size);
+  qx.setZero(size);
+  qy.setZero(size);
+  qz.setZero(size);
+  qw.setOnes(size);
+}
+
+void SwarmKernel::resize(const std::size_t _size)
+{
+  size_ = _size;
+  odom2baselink.resize(_size);
+  map2baselink.resize(_size);
+  global2map.resize(_size);
+  body_velocity.resize(_size);
+  map2odom.resize(_size);
+  global2baselink.resize(_size);
+  global_velocity.resize(_size);
+  global2odom_.resize(_size);
+  cross_.resize(_size);
+}
+
+void SwarmKernel::update()
+{
+  // map -> odom = map2baselink * odom2baselink^-1, as driftBetween()
+  const PoseArrays &a = map2baselink;
+  const PoseArrays &b = odom2baselink;
+  map2odom.qw = a.qw * b.qw + a.qx * b.qx + a.qy * b.qy + a.qz * b.qz;
+  map2odom.qx = -a.qw * b.qx + a.qx * b.qw - a.qy * b.qz + a.qz * b.qy;
+  map2odom.qy = -a.qw * b.qy + a.qx * b.qz + a.qy * b.qw - a.qz * b.qx;
+  map2odom.qz = -a.qw * b.qz - a.qx * b.qy + a.qy * b.qx + a.qz * b.qw;
+  // Translation: a.t - q * b.t, global2odom_ is free until composed below
+  rotate(map2odom, b.x, b.y, b.z, global2odom_.x, global2odom_.y, global2odom_.z, cross_);
+  map2odom.x = a.x - global2odom_.x;
+  map2odom.y = a.y - global2odom_.y;
+  map2odom.z = a.z - global2odom_.z;
+
+  compose(global2map, map2odom, global2odom_, cross_);
+  compose(global2odom_, odom2baselink, global2baselink, cross_);
+
+  rotate(global2baselink, body_velocity.x, body_velocity.y, body_velocity.z, global_velocity.x,
+         global_velocity.y, global_velocity.z, cross_);
+}
+
+void SwarmKernel::compose(const PoseArrays &_lhs, const PoseArrays &_rhs, PoseArrays &_out,
+                          VectorArrays &_cross)
+{
+  // Translation: lhs.t + lhs.q * rhs.t
+  rotate(_lhs, _rhs.x, _rhs.y, _rhs.z, _out.x, _out.y, _out.z, _cross);
+  _out.x += _lhs.x;
+  _out.y += _lhs.y;
+  _out.z += _lhs.z;
+
+  _out.qw = _lhs.qw * _rhs.qw - _lhs.qx * _rhs.qx - _lhs.qy * _rhs.qy - _lhs.qz * _rhs.qz;
+  _out.qx = _lhs.qw * _rhs.qx + _lhs.qx * _rhs.qw + _lhs.qy * _rhs.qz - _lhs.qz * _rhs.qy;
+  _out.qy = _lhs.qw * _rhs.qy - _lhs.qx * _rhs.qz + _lhs.qy * _rhs.qw + _lhs.qz * _rhs.qx;
+  _out.qz = _lhs.qw * _rhs.qz + _lhs.qx * _rhs.qy - _lhs.qy * _rhs.qx + _lhs.qz * _rhs.qw;
+}
+
+void SwarmKernel::rotate(const PoseArrays &_pose, const Eigen::ArrayXd &_x,
+                         const Eigen::ArrayXd &_y, const Eigen::ArrayXd &_z,
+                         Eigen::ArrayXd &_out_x, Eigen::ArrayXd &_out_y, Eigen::ArrayXd &_out_z,
+                         VectorArrays &_cross)
+{
+  // v' = v + w * t + u x t, with t = 2 * u x v
+  _cross.x = 2.0 * (_pose.qy * _z - _pose.qz * _y);
+  _cross.y = 2.0 * (_pose.qz * _x - _pose.qx * _z);
+  _cross.z = 2.0 * (_pose.qx * _y - _pose.qy * _x);
+  _out_x = _x + _pose.qw * _cross.x + (_pose.qy * _cross.z - _pose.qz * _cross.y);
+  _out_y = _y + _pose.qw * _cross.y + (_pose.qz * _cross.x - _pose.qx * _cross.z);
+  _out_z = _z + _pose.qw * _cross.z + (_pose.qx * _cross.y - _pose.qy * _cross.x);
+}
+
+} // namespace basic_state_estimator
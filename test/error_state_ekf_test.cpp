@@ -0,0 +1,152 @@
+/*!*******************************************************************************************
+ *  \file       error_state_ekf_test.cpp
+ *  \brief      Unit tests of the error state EKF
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include "error_state_ekf.hpp"
+
+namespace
+{
+
+using basic_state_estimator::ErrorStateEkf;
+
+ErrorStateEkf makeFilter()
+{
+  ErrorStateEkf ekf;
+  ekf.reset(Eigen::Vector3d::Zero(), Eigen::Quaterniond::Identity());
+  return ekf;
+}
+
+void expectCovarianceNear(const ErrorStateEkf::CovarianceMatrix &_expected,
+                          const ErrorStateEkf::CovarianceMatrix &_actual, const double _tolerance)
+{
+  EXPECT_LT((_expected - _actual).cwiseAbs().maxCoeff(),
+            _tolerance * _expected.cwiseAbs().maxCoeff())
+      << "expected\n"
+      << _expected << "\nactual\n"
+      << _actual;
+}
+
+} // namespace
+
+TEST(ErrorStateEkf, ConstantVelocityNoiseDoesNotDependOnTheRate)
+{
+  ErrorStateEkf one_step = makeFilter();
+  one_step.predict(1.0);
+  ErrorStateEkf many_steps = makeFilter();
+  for (int i = 0; i < 100; i++)
+  {
+    many_steps.predict(0.01);
+  }
+  expectCovarianceNear(one_step.covariance(), many_steps.covariance(), 1e-9);
+
+  // White noise acceleration: the velocity variance grows linearly and the position one with the
+  // cube of the time
+  const ErrorStateEkf initial = makeFilter();
+  const double acc_variance = 0.5 * 0.5;
+  EXPECT_NEAR(initial.covariance()(ErrorStateEkf::VELOCITY, ErrorStateEkf::VELOCITY) +
+                  acc_variance,
+              one_step.covariance()(ErrorStateEkf::VELOCITY, ErrorStateEkf::VELOCITY), 1e-12);
+  EXPECT_NEAR(initial.covariance()(ErrorStateEkf::POSITION, ErrorStateEkf::POSITION) +
+                  initial.covariance()(ErrorStateEkf::VELOCITY, ErrorStateEkf::VELOCITY) +
+                  acc_variance / 3.0,
+              one_step.covariance()(ErrorStateEkf::POSITION, ErrorStateEkf::POSITION), 1e-12);
+}
+
+TEST(ErrorStateEkf, ImuNoiseDoesNotDependOnTheRate)
+{
+  // Hovering, so the orientation and bias couplings are the only first order terms
+  const Eigen::Vector3d acc(0.0, 0.0, 9.81);
+  const Eigen::Vector3d gyro = Eigen::Vector3d::Zero();
+  ErrorStateEkf slow = makeFilter();
+  for (int i = 0; i < 10; i++)
+  {
+    slow.predict(acc, gyro, 0.01);
+  }
+  ErrorStateEkf fast = makeFilter();
+  for (int i = 0; i < 100; i++)
+  {
+    fast.predict(acc, gyro, 0.001);
+  }
+  // Growth of the variances over the same 0.1 s
+  const ErrorStateEkf initial = makeFilter();
+  const ErrorStateEkf::ErrorState slow_growth =
+      slow.covariance().diagonal() - initial.covariance().diagonal();
+  const ErrorStateEkf::ErrorState fast_growth =
+      fast.covariance().diagonal() - initial.covariance().diagonal();
+  for (const int block : {ErrorStateEkf::POSITION, ErrorStateEkf::VELOCITY,
+                          ErrorStateEkf::ORIENTATION, ErrorStateEkf::ACC_BIAS})
+  {
+    EXPECT_NEAR(slow_growth(block), fast_growth(block), 0.02 * slow_growth(block)) << block;
+  }
+  EXPECT_TRUE(slow.position().isZero(1e-9));
+  EXPECT_TRUE(slow.velocity().isZero(1e-9));
+}
+
+TEST(ErrorStateEkf, ConstantVelocityTurnsWithTheAngularVelocity)
+{
+  ErrorStateEkf ekf;
+  ekf.reset(Eigen::Vector3d::Zero(), Eigen::Quaterniond::Identity(),
+            Eigen::Vector3d(1.0, 0.0, 0.0));
+  for (int i = 0; i < 100; i++)
+  {
+    ekf.predict(0.01, Eigen::Vector3d(0.0, 0.0, M_PI_2));
+  }
+  // A quarter turn keeps the body velocity
+  EXPECT_TRUE(ekf.velocity().isApprox(Eigen::Vector3d(0.0, 1.0, 0.0), 1e-9));
+  EXPECT_TRUE((ekf.orientation().conjugate() * ekf.velocity())
+                  .isApprox(Eigen::Vector3d(1.0, 0.0, 0.0), 1e-9));
+}
+
+TEST(ErrorStateEkf, BodyVelocityUpdateIsRotatedToTheMapFrame)
+{
+  ErrorStateEkf ekf;
+  const Eigen::Quaterniond yaw(Eigen::AngleAxisd(M_PI_2, Eigen::Vector3d::UnitZ()));
+  ekf.reset(Eigen::Vector3d::Zero(), yaw);
+  const double velocity_variance =
+      ekf.covariance()(ErrorStateEkf::VELOCITY + 1, ErrorStateEkf::VELOCITY + 1);
+  for (int i = 0; i < 20; i++)
+  {
+    ekf.updateBodyVelocity(Eigen::Vector3d(2.0, 0.0, 0.0), 1e-4 * Eigen::Matrix3d::Identity());
+  }
+  // Forward in the body is along y in the map
+  EXPECT_TRUE(ekf.velocity().isApprox(Eigen::Vector3d(0.0, 2.0, 0.0), 1e-3));
+  EXPECT_LT(ekf.covariance()(ErrorStateEkf::VELOCITY + 1, ErrorStateEkf::VELOCITY + 1),
+            velocity_variance);
+  EXPECT_TRUE(ekf.position().isZero(1e-9));
+}
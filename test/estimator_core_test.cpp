@@ -0,0 +1,155 @@
+/*!*******************************************************************************************
+ *  \file       estimator_core_test.cpp
+ *  \brief      Unit tests of the estimation core
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include "estimation_modes.hpp"
+#include "estimator_core.hpp"
+#include "pose.hpp"
+
+namespace
+{
+
+using basic_state_estimator::Pose;
+
+Pose makePose(const double _x, const double _y, const double _z, const double _yaw)
+{
+  Pose pose;
+  pose.position = Eigen::Vector3d(_x, _y, _z);
+  pose.orientation = Eigen::Quaterniond(Eigen::AngleAxisd(_yaw, Eigen::Vector3d::UnitZ()));
+  return pose;
+}
+
+void expectPoseNear(const Pose &_expected, const Pose &_actual)
+{
+  EXPECT_NEAR(_expected.position.x(), _actual.position.x(), 1e-9);
+  EXPECT_NEAR(_expected.position.y(), _actual.position.y(), 1e-9);
+  EXPECT_NEAR(_expected.position.z(), _actual.position.z(), 1e-9);
+  EXPECT_NEAR(1.0, std::abs(_expected.orientation.dot(_actual.orientation)), 1e-9);
+}
+
+} // namespace
+
+TEST(EstimatorCore, DriftMatchesPublishedChain)
+{
+  const Pose odom2baselink = makePose(10.0, 0.0, 0.0, M_PI_2);
+  const Pose map2baselink = makePose(1.0, 2.0, 0.0, 0.0);
+  const Pose drift = basic_state_estimator::driftBetween(odom2baselink, map2baselink);
+  expectPoseNear(map2baselink, basic_state_estimator::compose(drift, odom2baselink));
+}
+
+TEST(EstimatorCore, RotatedHandoverKeepsGlobalPose)
+{
+  basic_state_estimator::EstimatorCore core;
+  core.setGlobal2Map(makePose(100.0, 50.0, 0.0, 0.3));
+  core.localize(makePose(1.0, 2.0, 0.0, 0.0), true, true);
+
+  // The source failed over to reports the same pose yawed 90 degrees and elsewhere
+  core.beginHandover();
+  const Pose odom2baselink = makePose(10.0, 0.0, 0.0, M_PI_2);
+  const Pose map2baselink = core.localize(odom2baselink, true, true);
+  expectPoseNear(makePose(1.0, 2.0, 0.0, 0.0), map2baselink);
+
+  // map -> odom and the global pose as the node publishes them
+  const Pose map2odom = basic_state_estimator::driftBetween(odom2baselink, map2baselink);
+  expectPoseNear(basic_state_estimator::compose(core.global2map(), map2baselink),
+                 core.globalPose(map2odom, odom2baselink));
+}
+
+TEST(EstimatorCore, RotatedHandoverKeepsBodyMotion)
+{
+  basic_state_estimator::EstimatorCore core;
+  core.localize(makePose(1.0, 2.0, 0.0, 0.5), true, true);
+  core.beginHandover();
+  const Pose odom2baselink = makePose(10.0, 0.0, 0.0, M_PI_2);
+  const Pose before = core.localize(odom2baselink, true, true);
+
+  // One meter forward in the body frame of the new source is one meter forward after the offset
+  const Pose step = makePose(1.0, 0.0, 0.0, 0.0);
+  const Pose after = core.localize(basic_state_estimator::compose(odom2baselink, step), true, true);
+  expectPoseNear(basic_state_estimator::compose(before, step), after);
+}
+
+TEST(EstimatorCore, RotatedModeSwitchContinuesWithoutJump)
+{
+  using basic_state_estimator::GroundTruthMode;
+  using basic_state_estimator::OdomOnlyMode;
+  basic_state_estimator::EstimatorCore core;
+  core.setGlobal2Map(makePose(-5.0, 3.0, 0.0, -1.0));
+  const Pose odometry = makePose(3.0, 4.0, 1.0, M_PI / 6.0);
+  const Pose last = core.localize(odometry, OdomOnlyMode::offset_on_switch, true);
+
+  // Switched to ground truth, which has not published yet and then disagrees with the odometry
+  core.beginHandover();
+  const Pose ground_truth = makePose(-2.0, 7.0, 1.5, -M_PI / 3.0);
+  expectPoseNear(last, core.localize(ground_truth, GroundTruthMode::offset_on_switch, false));
+  const Pose map2baselink = core.localize(ground_truth, GroundTruthMode::offset_on_switch, true);
+  expectPoseNear(last, map2baselink);
+
+  const Pose map2odom = basic_state_estimator::driftBetween(ground_truth, map2baselink);
+  expectPoseNear(basic_state_estimator::compose(core.global2map(), last),
+                 core.globalPose(map2odom, ground_truth));
+
+  // And back, the offset of the ground truth is dropped for the odometry one
+  core.beginHandover();
+  const Pose moved = basic_state_estimator::compose(odometry, makePose(0.5, 0.0, 0.0, 0.2));
+  expectPoseNear(map2baselink, core.localize(moved, OdomOnlyMode::offset_on_switch, true));
+}
+
+TEST(EstimatorCore, GroundTruthVelocityTurnsWithTheModeOffset)
+{
+  using basic_state_estimator::GroundTruthMode;
+  using basic_state_estimator::OdomOnlyMode;
+  basic_state_estimator::EstimatorCore core;
+  const Eigen::Vector3d velocity(1.0, 0.5, 0.2);
+  EXPECT_EQ(core.globalVelocity<GroundTruthMode>(Pose(), velocity), velocity);
+
+  core.localize(makePose(3.0, 4.0, 1.0, M_PI / 6.0), OdomOnlyMode::offset_on_switch, true);
+  core.beginHandover();
+  const Pose ground_truth = makePose(-2.0, 7.0, 1.5, -M_PI / 3.0);
+  const Pose before = core.localize(ground_truth, GroundTruthMode::offset_on_switch, true);
+
+  // The published velocity follows the published pose, not the ground truth one
+  const double dt = 0.1;
+  Pose moved = ground_truth;
+  moved.position += velocity * dt;
+  const Pose after = core.localize(moved, GroundTruthMode::offset_on_switch, true);
+  const Eigen::Vector3d global_velocity = core.globalVelocity<GroundTruthMode>(after, velocity);
+  EXPECT_LT((global_velocity - (after.position - before.position) / dt).norm(), 1e-9);
+  EXPECT_NEAR(global_velocity.norm(), velocity.norm(), 1e-9);
+}
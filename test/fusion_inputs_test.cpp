@@ -0,0 +1,207 @@
+/*!*******************************************************************************************
+ *  \file       fusion_inputs_test.cpp
+ *  \brief      Unit tests of the sensor fusion inputs
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include "fusion_inputs.hpp"
+#include "pose.hpp"
+
+namespace
+{
+
+using basic_state_estimator::Pose;
+
+Pose makePose(const double _x, const double _y, const double _z, const double _yaw)
+{
+  Pose pose;
+  pose.position = Eigen::Vector3d(_x, _y, _z);
+  pose.orientation = Eigen::Quaterniond(Eigen::AngleAxisd(_yaw, Eigen::Vector3d::UnitZ()));
+  return pose;
+}
+
+constexpr int64_t start_stamp = 1000000000; // [ns]
+constexpr int64_t millisecond = 1000000;    // [ns]
+
+// Position error of the filter against a trajectory, at the filter stamp
+template <typename TrajectoryT>
+double positionError(const basic_state_estimator::LagCompensatedFilter &_filter,
+                     const TrajectoryT &_trajectory)
+{
+  const double t = (_filter.stamp() - start_stamp) * 1e-9;
+  return (_filter.filter().position() - _trajectory(t).position).norm();
+}
+
+/**
+ * @brief 10 s of perfect odometry at 50 Hz, with IMU at 200 Hz if _imu, offset so no odometry
+ * shares a stamp with the IMU
+ */
+template <typename TrajectoryT>
+double fuseTrajectory(const TrajectoryT &_trajectory, const Eigen::Vector3d &_body_velocity,
+                      const Eigen::Vector3d &_body_angular_velocity,
+                      const Eigen::Vector3d &_specific_force, const bool _imu)
+{
+  const basic_state_estimator::FusionParameters parameters;
+  basic_state_estimator::LagCompensatedFilter filter =
+      basic_state_estimator::makeFusionFilter(parameters);
+  for (int ms = 0; ms <= 10000; ms++)
+  {
+    const int64_t stamp = start_stamp + ms * millisecond;
+    if (_imu && ms % 5 == 0 && filter.isInitialized())
+    {
+      filter.addImu(stamp, _specific_force, _body_angular_velocity);
+    }
+    if (ms % 20 == 3)
+    {
+      basic_state_estimator::fuseOdometry(filter, parameters, stamp, 0, Pose(),
+                                          _trajectory(ms * 1e-3), _body_velocity,
+                                          _body_angular_velocity,
+                                          basic_state_estimator::Matrix6d::Zero(),
+                                          basic_state_estimator::Matrix6d::Zero());
+    }
+  }
+  return positionError(filter, _trajectory);
+}
+
+} // namespace
+
+TEST(FusionInputs, OdometryIsComposedWithTheDrift)
+{
+  const basic_state_estimator::FusionParameters parameters;
+  basic_state_estimator::LagCompensatedFilter filter =
+      basic_state_estimator::makeFusionFilter(parameters);
+  const Pose map2odom = makePose(1.0, 2.0, 0.0, M_PI_2);
+  const Pose odom2baselink = makePose(10.0, 0.0, 0.0, 0.0);
+  const Eigen::Vector3d body_velocity(1.0, 0.0, 0.0);
+  ASSERT_TRUE(basic_state_estimator::fuseOdometry(
+      filter, parameters, 1000, 0, map2odom, odom2baselink, body_velocity, Eigen::Vector3d::Zero(),
+      basic_state_estimator::Matrix6d::Zero(), basic_state_estimator::Matrix6d::Zero()));
+
+  // First sample initializes the filter at map -> odom -> base_link
+  ASSERT_TRUE(filter.isInitialized());
+  const Pose map2baselink = basic_state_estimator::compose(map2odom, odom2baselink);
+  EXPECT_TRUE(filter.filter().position().isApprox(map2baselink.position, 1e-9));
+  EXPECT_NEAR(1.0, std::abs(filter.filter().orientation().dot(map2baselink.orientation)), 1e-9);
+  EXPECT_TRUE(filter.filter().velocity().isApprox(Eigen::Vector3d(0.0, 1.0, 0.0), 1e-9));
+}
+
+TEST(FusionInputs, AbsolutePoseInitializesTheFilter)
+{
+  const basic_state_estimator::FusionParameters parameters;
+  basic_state_estimator::LagCompensatedFilter filter =
+      basic_state_estimator::makeFusionFilter(parameters);
+  const Pose pose = makePose(3.0, -1.0, 2.0, 0.7);
+  ASSERT_TRUE(basic_state_estimator::fuseAbsolutePose(filter, parameters, 1000, pose));
+  EXPECT_TRUE(filter.filter().position().isApprox(pose.position, 1e-9));
+  EXPECT_NEAR(1.0, std::abs(filter.filter().orientation().dot(pose.orientation)), 1e-9);
+}
+
+TEST(FusionInputs, MinimumStdOnlyRaisesTheDiagonal)
+{
+  basic_state_estimator::Matrix6d covariance = basic_state_estimator::Matrix6d::Zero();
+  covariance(0, 0) = 1.0;
+  covariance(0, 1) = 0.5;
+  basic_state_estimator::applyMinimumStd(covariance, 0.1, 0.2);
+  EXPECT_DOUBLE_EQ(1.0, covariance(0, 0));
+  EXPECT_DOUBLE_EQ(0.01, covariance(1, 1));
+  EXPECT_DOUBLE_EQ(0.04, covariance(5, 5));
+  EXPECT_DOUBLE_EQ(0.5, covariance(0, 1));
+}
+
+TEST(FusionInputs, OdometryWithImuDoesNotWalkAway)
+{
+  // The odometry is never mapped through a drift from another stamp, so perfect odometry is
+  // followed with and without IMU
+  const double speed = 2.0;
+  const auto trajectory = [speed](const double _t) { return makePose(speed * _t, 0.0, 1.0, 0.0); };
+  const Eigen::Vector3d body_velocity(speed, 0.0, 0.0);
+  const Eigen::Vector3d specific_force(0.0, 0.0, 9.81);
+  EXPECT_LT(fuseTrajectory(trajectory, body_velocity, Eigen::Vector3d::Zero(), specific_force,
+                           true),
+            1e-3);
+  EXPECT_LT(fuseTrajectory(trajectory, body_velocity, Eigen::Vector3d::Zero(), specific_force,
+                           false),
+            1e-3);
+}
+
+TEST(FusionInputs, TurnWithoutImuFollowsOdometry)
+{
+  // Circle of 4 m at 2 m/s. The constant velocity model turns with the odometry angular velocity,
+  // otherwise only part of each increment is applied and the estimate spirals away.
+  const double speed = 2.0;
+  const double yaw_rate = 0.5;
+  const double radius = speed / yaw_rate;
+  const auto trajectory = [=](const double _t) {
+    return makePose(radius * std::cos(yaw_rate * _t), radius * std::sin(yaw_rate * _t), 1.0,
+                    yaw_rate * _t + M_PI_2);
+  };
+  EXPECT_LT(fuseTrajectory(trajectory, Eigen::Vector3d(speed, 0.0, 0.0),
+                           Eigen::Vector3d(0.0, 0.0, yaw_rate), Eigen::Vector3d(0.0, 0.0, 9.81),
+                           false),
+            0.05);
+}
+
+TEST(FusionInputs, NewOdometrySourceIsAnchoredAgain)
+{
+  const basic_state_estimator::FusionParameters parameters;
+  basic_state_estimator::LagCompensatedFilter filter =
+      basic_state_estimator::makeFusionFilter(parameters);
+  const Eigen::Vector3d velocity = Eigen::Vector3d::Zero();
+  const basic_state_estimator::Matrix6d covariance = basic_state_estimator::Matrix6d::Zero();
+  for (int i = 0; i < 5; i++)
+  {
+    basic_state_estimator::fuseOdometry(filter, parameters, start_stamp + i * 20 * millisecond, 0,
+                                        Pose(), makePose(1.0, 0.0, 0.0, 0.0), velocity, velocity,
+                                        covariance, covariance);
+  }
+  // A source with another odom frame only anchors on its first sample, then moves the filter by
+  // its increments
+  basic_state_estimator::fuseOdometry(filter, parameters, start_stamp + 100 * millisecond, 1,
+                                      Pose(), makePose(50.0, 20.0, 0.0, M_PI_2), velocity,
+                                      velocity, covariance, covariance);
+  EXPECT_TRUE(filter.filter().position().isApprox(Eigen::Vector3d(1.0, 0.0, 0.0), 1e-6));
+  for (int i = 1; i <= 50; i++)
+  {
+    basic_state_estimator::fuseOdometry(
+        filter, parameters, start_stamp + (100 + i * 20) * millisecond, 1, Pose(),
+        makePose(50.0, 20.0 + 0.01 * i, 0.0, M_PI_2), Eigen::Vector3d(0.5, 0.0, 0.0), velocity,
+        covariance, covariance);
+  }
+  // 0.5 m forward along the new odom y axis is along x in map
+  EXPECT_NEAR(1.5, filter.filter().position().x(), 0.05);
+  EXPECT_NEAR(0.0, filter.filter().position().y(), 0.01);
+}
@@ -0,0 +1,129 @@
+/*!*******************************************************************************************
+ *  \file       imu_propagator_test.cpp
+ *  \brief      Unit tests of the IMU propagation of odometry
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdint>
+
+#include "imu_propagator.hpp"
+
+namespace
+{
+
+using basic_state_estimator::ImuPropagator;
+
+constexpr int64_t millisecond = 1000000;
+
+// Specific force of a level IMU at rest
+const Eigen::Vector3d at_rest(0.0, 0.0, 9.81);
+
+Eigen::Quaterniond yaw(const double _angle)
+{
+  return Eigen::Quaterniond(Eigen::AngleAxisd(_angle, Eigen::Vector3d::UnitZ()));
+}
+
+// IMU samples every 10 ms from 10 ms to _last_ms
+void addImu(ImuPropagator &_propagator, const int _last_ms, const Eigen::Vector3d &_acc,
+            const Eigen::Vector3d &_gyro)
+{
+  for (int ms = 10; ms <= _last_ms; ms += 10)
+  {
+    _propagator.addImu(ms * millisecond, _acc, _gyro);
+  }
+}
+
+} // namespace
+
+TEST(ImuPropagator, ConstantAcceleration)
+{
+  ImuPropagator propagator;
+  propagator.setMaxHorizon(1000 * millisecond);
+  // Facing y, moving along x at 1 m/s and accelerating forward at 2 m/s^2
+  propagator.reset(0, Eigen::Vector3d(1.0, 2.0, 3.0), yaw(M_PI / 2.0), Eigen::Vector3d(1.0, 0, 0),
+                   Eigen::Vector3d::Zero());
+  addImu(propagator, 500, Eigen::Vector3d(2.0, 0.0, 0.0) + at_rest, Eigen::Vector3d::Zero());
+
+  const double t = 0.5;
+  EXPECT_EQ(propagator.state().stamp, 500 * millisecond);
+  EXPECT_EQ(propagator.integratedSamples(), 50u);
+  EXPECT_LT((propagator.state().position - Eigen::Vector3d(1.0 + t, 2.0 + t * t, 3.0)).norm(),
+            1e-9);
+  EXPECT_LT((propagator.state().velocity - Eigen::Vector3d(1.0, 2.0 * t, 0.0)).norm(), 1e-9);
+  EXPECT_LT(propagator.state().orientation.angularDistance(yaw(M_PI / 2.0)), 1e-9);
+}
+
+TEST(ImuPropagator, GyroOnlyRotation)
+{
+  ImuPropagator propagator;
+  propagator.setMaxHorizon(2000 * millisecond);
+  propagator.reset(0, Eigen::Vector3d::Zero(), Eigen::Quaterniond::Identity(),
+                   Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero());
+  addImu(propagator, 1000, at_rest, Eigen::Vector3d(0.0, 0.0, 0.5));
+
+  // The specific force rotates with the body, so it keeps cancelling gravity
+  EXPECT_LT(propagator.state().orientation.angularDistance(yaw(0.5)), 1e-9);
+  EXPECT_LT(propagator.state().position.norm(), 1e-9);
+  EXPECT_LT(propagator.state().velocity.norm(), 1e-9);
+  EXPECT_EQ(propagator.state().angular_velocity, Eigen::Vector3d(0.0, 0.0, 0.5));
+}
+
+TEST(ImuPropagator, NewOdometryResetsTheAnchor)
+{
+  // Not integrated without an anchor, but kept for the next one
+  ImuPropagator propagator;
+  EXPECT_FALSE(propagator.addImu(5 * millisecond, at_rest, Eigen::Vector3d::Zero()));
+
+  propagator.reset(0, Eigen::Vector3d::Zero(), Eigen::Quaterniond::Identity(),
+                   Eigen::Vector3d(1.0, 0.0, 0.0), Eigen::Vector3d::Zero());
+  addImu(propagator, 100, at_rest, Eigen::Vector3d::Zero());
+  EXPECT_EQ(propagator.integratedSamples(), 11u);
+  EXPECT_NEAR(propagator.state().position.x(), 0.1, 1e-9);
+
+  // Odometry at 50 ms: only the IMU samples after it are integrated again, from the new anchor
+  propagator.reset(50 * millisecond, Eigen::Vector3d(5.0, 0.0, 0.0), yaw(M_PI / 2.0),
+                   Eigen::Vector3d(0.0, 2.0, 0.0), Eigen::Vector3d::Zero());
+  EXPECT_EQ(propagator.integratedSamples(), 5u);
+  EXPECT_EQ(propagator.state().stamp, 100 * millisecond);
+  EXPECT_LT((propagator.state().position - Eigen::Vector3d(5.0, 0.1, 0.0)).norm(), 1e-9);
+  EXPECT_LT((propagator.state().velocity - Eigen::Vector3d(0.0, 2.0, 0.0)).norm(), 1e-9);
+  EXPECT_LT(propagator.state().orientation.angularDistance(yaw(M_PI / 2.0)), 1e-9);
+
+  // Beyond the max horizon of the anchor, 100 ms by default
+  EXPECT_TRUE(propagator.addImu(150 * millisecond, at_rest, Eigen::Vector3d::Zero()));
+  EXPECT_FALSE(propagator.addImu(160 * millisecond, at_rest, Eigen::Vector3d::Zero()));
+  EXPECT_EQ(propagator.state().stamp, 150 * millisecond);
+}
@@ -0,0 +1,156 @@
+/*!*******************************************************************************************
+ *  \file       lag_compensated_filter_test.cpp
+ *  \brief      Unit tests of the lag compensated filter replay
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+
+#include "lag_compensated_filter.hpp"
+
+namespace
+{
+
+using basic_state_estimator::ErrorStateEkf;
+using basic_state_estimator::LagCompensatedFilter;
+
+constexpr int64_t millisecond = 1000000;
+
+const ErrorStateEkf::Matrix6d pose_covariance = ErrorStateEkf::Matrix6d::Identity() * 0.01;
+
+LagCompensatedFilter makeFilter(const std::size_t _window = 256,
+                                const std::size_t _max_replay_depth = 64)
+{
+  LagCompensatedFilter filter(_window, _max_replay_depth);
+  filter.initialize(0, Eigen::Vector3d::Zero(), Eigen::Quaterniond::Identity());
+  return filter;
+}
+
+// IMU every 10 ms from 10 ms on, accelerating and turning so every input changes the state
+void addImu(LagCompensatedFilter &_filter, const int _first, const int _last)
+{
+  for (int i = _first; i <= _last; i++)
+  {
+    ASSERT_TRUE(_filter.addImu(i * 10 * millisecond, Eigen::Vector3d(0.5, 0.0, 9.81),
+                               Eigen::Vector3d(0.0, 0.0, 0.2)));
+  }
+}
+
+bool addPose(LagCompensatedFilter &_filter, const int64_t _stamp)
+{
+  return _filter.addPose(_stamp, Eigen::Vector3d(0.1, -0.1, 0.0), Eigen::Quaterniond::Identity(),
+                         pose_covariance);
+}
+
+void expectSameState(const ErrorStateEkf &_expected, const ErrorStateEkf &_actual)
+{
+  EXPECT_LT((_expected.position() - _actual.position()).norm(), 1e-12);
+  EXPECT_LT((_expected.velocity() - _actual.velocity()).norm(), 1e-12);
+  EXPECT_LT(_expected.orientation().angularDistance(_actual.orientation()), 1e-12);
+  EXPECT_LT((_expected.covariance() - _actual.covariance()).cwiseAbs().maxCoeff(), 1e-12);
+}
+
+} // namespace
+
+TEST(LagCompensatedFilter, DelayedInputReappliesOnlyTheSuffix)
+{
+  LagCompensatedFilter filter = makeFilter();
+  addImu(filter, 1, 10);
+  EXPECT_EQ(filter.replayedInputs(), 0u);
+
+  // Between the IMU samples at 70 and 80 ms, the ones at 80, 90 and 100 ms are re-applied
+  ASSERT_TRUE(addPose(filter, 75 * millisecond));
+  EXPECT_EQ(filter.replayedInputs(), 3u);
+  EXPECT_EQ(filter.stamp(), 100 * millisecond);
+
+  // In order inputs replay nothing
+  addImu(filter, 11, 11);
+  EXPECT_EQ(filter.replayedInputs(), 3u);
+  EXPECT_EQ(filter.droppedInputs(), 0u);
+}
+
+TEST(LagCompensatedFilter, DelayedInputMatchesInOrderProcessing)
+{
+  LagCompensatedFilter in_order = makeFilter();
+  addImu(in_order, 1, 7);
+  ASSERT_TRUE(addPose(in_order, 75 * millisecond));
+  addImu(in_order, 8, 20);
+
+  LagCompensatedFilter delayed = makeFilter();
+  addImu(delayed, 1, 20);
+  ASSERT_TRUE(addPose(delayed, 75 * millisecond));
+
+  EXPECT_EQ(delayed.replayedInputs(), 13u);
+  EXPECT_EQ(delayed.stamp(), in_order.stamp());
+  expectSameState(in_order.filter(), delayed.filter());
+}
+
+TEST(LagCompensatedFilter, ReplayDepthIsBounded)
+{
+  LagCompensatedFilter filter = makeFilter(256, 4);
+  addImu(filter, 1, 10);
+
+  // Before the 5 newest inputs, it would need a replay deeper than 4
+  const ErrorStateEkf before = filter.filter();
+  EXPECT_FALSE(addPose(filter, 55 * millisecond));
+  EXPECT_EQ(filter.droppedInputs(), 1u);
+  EXPECT_EQ(filter.replayedInputs(), 0u);
+  expectSameState(before, filter.filter());
+
+  // Before the 4 newest inputs, as deep as allowed
+  EXPECT_TRUE(addPose(filter, 65 * millisecond));
+  EXPECT_EQ(filter.replayedInputs(), 4u);
+  EXPECT_EQ(filter.droppedInputs(), 1u);
+}
+
+TEST(LagCompensatedFilter, InputsOlderThanTheWindowAreDropped)
+{
+  // Before the first input there is no state to restore
+  LagCompensatedFilter filter = makeFilter(8);
+  addImu(filter, 1, 4);
+  EXPECT_FALSE(addPose(filter, 5 * millisecond));
+  EXPECT_EQ(filter.droppedInputs(), 1u);
+
+  // Once the window wrapped, only the 8 newest inputs are kept: the IMU samples from 130 ms on
+  addImu(filter, 5, 20);
+  const ErrorStateEkf before = filter.filter();
+  EXPECT_FALSE(addPose(filter, 125 * millisecond));
+  EXPECT_EQ(filter.droppedInputs(), 2u);
+  expectSameState(before, filter.filter());
+
+  EXPECT_TRUE(addPose(filter, 135 * millisecond));
+  EXPECT_EQ(filter.replayedInputs(), 7u);
+  EXPECT_EQ(filter.stamp(), 200 * millisecond);
+}
@@ -0,0 +1,165 @@
+/*!*******************************************************************************************
+ *  \file       state_history_test.cpp
+ *  \brief      Unit tests of the state history ring buffer
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdint>
+
+#include "state_history.hpp"
+
+namespace
+{
+
+using basic_state_estimator::StateHistory;
+using basic_state_estimator::StateSample;
+
+// Moving along x at 1 m/s, sample _index at _index seconds
+StateSample makeSample(const int64_t _index)
+{
+  StateSample sample;
+  sample.stamp = _index * 1000000000;
+  sample.position = Eigen::Vector3d(static_cast<double>(_index), 0.0, 1.0);
+  sample.linear_velocity = Eigen::Vector3d(1.0, 0.0, 0.0);
+  return sample;
+}
+
+Eigen::Quaterniond yaw(const double _angle)
+{
+  return Eigen::Quaterniond(Eigen::AngleAxisd(_angle, Eigen::Vector3d::UnitZ()));
+}
+
+} // namespace
+
+TEST(StateHistory, LookupFindsEveryStoredSample)
+{
+  StateHistory history(128);
+  for (int64_t i = 0; i < 100; i++)
+  {
+    ASSERT_TRUE(history.push(makeSample(i)));
+  }
+  StateSample sample;
+  for (int64_t i = 0; i < 100; i++)
+  {
+    ASSERT_TRUE(history.lookup(makeSample(i).stamp, sample));
+    EXPECT_EQ(sample.stamp, makeSample(i).stamp);
+    EXPECT_EQ(sample.position.x(), static_cast<double>(i));
+  }
+
+  // Between samples 41 and 42
+  ASSERT_TRUE(history.lookup(41250000000, sample));
+  EXPECT_EQ(sample.stamp, 41250000000);
+  EXPECT_NEAR(sample.position.x(), 41.25, 1e-12);
+  EXPECT_NEAR(sample.linear_velocity.x(), 1.0, 1e-12);
+}
+
+TEST(StateHistory, LookupSlerpsTheOrientation)
+{
+  StateHistory history(4);
+  StateSample first = makeSample(0);
+  first.orientation = yaw(0.0);
+  first.angular_velocity = Eigen::Vector3d::Zero();
+  StateSample second = makeSample(1);
+  second.orientation = yaw(M_PI / 2.0);
+  second.angular_velocity = Eigen::Vector3d(0.0, 0.0, 2.0);
+  ASSERT_TRUE(history.push(first));
+  ASSERT_TRUE(history.push(second));
+
+  StateSample sample;
+  ASSERT_TRUE(history.lookup(250000000, sample));
+  EXPECT_NEAR(sample.orientation.angularDistance(yaw(M_PI / 8.0)), 0.0, 1e-12);
+  EXPECT_NEAR(sample.orientation.norm(), 1.0, 1e-12);
+  EXPECT_NEAR(sample.angular_velocity.z(), 0.5, 1e-12);
+  EXPECT_NEAR(sample.position.x(), 0.25, 1e-12);
+}
+
+TEST(StateHistory, OldestSamplesAreOverwritten)
+{
+  StateHistory history(4);
+  for (int64_t i = 0; i < 6; i++)
+  {
+    ASSERT_TRUE(history.push(makeSample(i)));
+  }
+  EXPECT_EQ(history.size(), 4u);
+  EXPECT_EQ(history.oldest().stamp, makeSample(2).stamp);
+  EXPECT_EQ(history.newest().stamp, makeSample(5).stamp);
+
+  StateSample sample;
+  EXPECT_FALSE(history.lookup(makeSample(1).stamp, sample));
+  // Samples 3 and 4 sit on both sides of the end of the storage
+  ASSERT_TRUE(history.lookup(3500000000, sample));
+  EXPECT_NEAR(sample.position.x(), 3.5, 1e-12);
+  ASSERT_TRUE(history.lookup(makeSample(5).stamp, sample));
+  EXPECT_EQ(sample.position.x(), 5.0);
+}
+
+TEST(StateHistory, StampsOutOfTheHistoryAreRejected)
+{
+  StateHistory history(4);
+  StateSample sample;
+  EXPECT_FALSE(history.lookup(0, sample));
+
+  ASSERT_TRUE(history.push(makeSample(1)));
+  ASSERT_TRUE(history.push(makeSample(2)));
+  EXPECT_FALSE(history.lookup(makeSample(1).stamp - 1, sample));
+  EXPECT_FALSE(history.lookup(makeSample(2).stamp + 1, sample));
+  EXPECT_TRUE(history.lookup(makeSample(1).stamp, sample));
+
+  // Samples not newer than the last one are not stored
+  EXPECT_FALSE(history.push(makeSample(2)));
+  EXPECT_FALSE(history.push(makeSample(0)));
+  EXPECT_EQ(history.size(), 2u);
+}
+
+TEST(StateHistory, VelocitiesInDifferentFramesAreNotInterpolated)
+{
+  StateHistory history(4);
+  StateSample first = makeSample(0);
+  StateSample second = makeSample(1);
+  second.twist_frame = 1;
+  second.linear_velocity = Eigen::Vector3d(0.0, 3.0, 0.0);
+  ASSERT_TRUE(history.push(first));
+  ASSERT_TRUE(history.push(second));
+
+  StateSample sample;
+  ASSERT_TRUE(history.lookup(250000000, sample));
+  EXPECT_EQ(sample.twist_frame, 0u);
+  EXPECT_EQ(sample.linear_velocity, first.linear_velocity);
+  EXPECT_NEAR(sample.position.x(), 0.25, 1e-12);
+  ASSERT_TRUE(history.lookup(750000000, sample));
+  EXPECT_EQ(sample.twist_frame, 1u);
+  EXPECT_EQ(sample.linear_velocity, second.linear_velocity);
+}
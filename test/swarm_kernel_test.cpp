@@ -0,0 +1,125 @@
+/*!*******************************************************************************************
+ *  \file       swarm_kernel_test.cpp
+ *  \brief      Unit tests of the batched estimation of the multi-drone host
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "estimator_core.hpp"
+#include "pose.hpp"
+#include "swarm_kernel.hpp"
+
+namespace
+{
+
+using basic_state_estimator::Pose;
+
+Pose randomPose()
+{
+  Pose pose;
+  pose.position = Eigen::Vector3d::Random() * 10.0;
+  pose.orientation = Eigen::Quaterniond(Eigen::Vector4d::Random()).normalized();
+  return pose;
+}
+
+void setColumn(basic_state_estimator::PoseArrays &_arrays, const Eigen::Index _index,
+               const Pose &_pose)
+{
+  _arrays.x[_index] = _pose.position.x();
+  _arrays.y[_index] = _pose.position.y();
+  _arrays.z[_index] = _pose.position.z();
+  _arrays.qx[_index] = _pose.orientation.x();
+  _arrays.qy[_index] = _pose.orientation.y();
+  _arrays.qz[_index] = _pose.orientation.z();
+  _arrays.qw[_index] = _pose.orientation.w();
+}
+
+void expectColumnNear(const Pose &_expected, const basic_state_estimator::PoseArrays &_arrays,
+                      const Eigen::Index _index)
+{
+  EXPECT_NEAR(_expected.position.x(), _arrays.x[_index], 1e-9);
+  EXPECT_NEAR(_expected.position.y(), _arrays.y[_index], 1e-9);
+  EXPECT_NEAR(_expected.position.z(), _arrays.z[_index], 1e-9);
+  const Eigen::Quaterniond orientation(_arrays.qw[_index], _arrays.qx[_index],
+                                       _arrays.qy[_index], _arrays.qz[_index]);
+  EXPECT_NEAR(1.0, std::abs(_expected.orientation.dot(orientation)), 1e-9);
+}
+
+} // namespace
+
+TEST(SwarmKernel, MatchesUnbatchedEstimation)
+{
+  const std::size_t drones = 17;
+  basic_state_estimator::SwarmKernel kernel(drones);
+  std::vector<Pose> odom2baselink, map2baselink, global2map;
+  std::vector<Eigen::Vector3d> body_velocity;
+  for (Eigen::Index i = 0; i < static_cast<Eigen::Index>(drones); i++)
+  {
+    // Drift with rotation, as after a handover between sources with different yaw
+    odom2baselink.push_back(randomPose());
+    map2baselink.push_back(randomPose());
+    global2map.push_back(randomPose());
+    body_velocity.push_back(Eigen::Vector3d::Random());
+    setColumn(kernel.odom2baselink, i, odom2baselink.back());
+    setColumn(kernel.map2baselink, i, map2baselink.back());
+    setColumn(kernel.global2map, i, global2map.back());
+    kernel.body_velocity.x[i] = body_velocity.back().x();
+    kernel.body_velocity.y[i] = body_velocity.back().y();
+    kernel.body_velocity.z[i] = body_velocity.back().z();
+  }
+  kernel.update();
+
+  for (std::size_t drone = 0; drone < drones; drone++)
+  {
+    const Eigen::Index i = static_cast<Eigen::Index>(drone);
+    basic_state_estimator::EstimatorCore core;
+    core.setGlobal2Map(global2map[drone]);
+    const Pose map2odom =
+        basic_state_estimator::driftBetween(odom2baselink[drone], map2baselink[drone]);
+    const Pose global2baselink = core.globalPose(map2odom, odom2baselink[drone]);
+    expectColumnNear(map2odom, kernel.map2odom, i);
+    expectColumnNear(global2baselink, kernel.global2baselink, i);
+    expectColumnNear(basic_state_estimator::compose(global2map[drone], map2baselink[drone]),
+                     kernel.global2baselink, i);
+
+    const Eigen::Vector3d global_velocity = global2baselink.orientation * body_velocity[drone];
+    EXPECT_NEAR(global_velocity.x(), kernel.global_velocity.x[i], 1e-9);
+    EXPECT_NEAR(global_velocity.y(), kernel.global_velocity.y[i], 1e-9);
+    EXPECT_NEAR(global_velocity.z(), kernel.global_velocity.z[i], 1e-9);
+  }
+}
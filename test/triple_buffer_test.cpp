@@ -0,0 +1,131 @@
+/*!*******************************************************************************************
+ *  \file       triple_buffer_test.cpp
+ *  \brief      Unit tests of the lock-free triple buffer
+ *  \authors    Miguel Fernández Cortizas
+ *              David Pérez Saura
+ *              Rafael Pérez Seguí
+ *              Pedro Arias Pérez
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "triple_buffer.hpp"
+
+namespace
+{
+
+using basic_state_estimator::TripleBuffer;
+
+// Every word holds the sequence number, a torn sample mixes two of them
+struct Sample
+{
+  std::array<uint64_t, 16> words{};
+
+  void fill(const uint64_t _seq) { words.fill(_seq); }
+  bool isConsistent() const
+  {
+    for (const uint64_t word : words)
+    {
+      if (word != words.front())
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+} // namespace
+
+TEST(TripleBuffer, PublishesTheLatestSample)
+{
+  TripleBuffer<Sample> buffer;
+  EXPECT_FALSE(buffer.update());
+
+  buffer.write().fill(1);
+  EXPECT_FALSE(buffer.publish());
+  buffer.write().fill(2);
+  // Sample 1 was never picked up
+  EXPECT_TRUE(buffer.publish());
+
+  ASSERT_TRUE(buffer.update());
+  EXPECT_EQ(buffer.read().words.front(), 2u);
+  EXPECT_FALSE(buffer.update());
+  EXPECT_EQ(buffer.read().words.front(), 2u);
+}
+
+TEST(TripleBuffer, ConcurrentConsumerSeesNoTornSample)
+{
+  constexpr uint64_t samples = 200000;
+  TripleBuffer<Sample> buffer;
+  std::atomic<bool> produced{false};
+
+  std::thread producer([&buffer, &produced]() {
+    for (uint64_t seq = 1; seq <= samples; seq++)
+    {
+      buffer.write().fill(seq);
+      buffer.publish();
+    }
+    produced = true;
+  });
+
+  uint64_t last = 0;
+  uint64_t torn = 0;
+  uint64_t out_of_order = 0;
+  uint64_t updates = 0;
+  while (last < samples)
+  {
+    const bool done = produced.load();
+    if (buffer.update())
+    {
+      updates++;
+      const Sample &sample = buffer.read();
+      torn += sample.isConsistent() ? 0 : 1;
+      out_of_order += sample.words.front() > last ? 0 : 1;
+      last = sample.words.front();
+    }
+    else if (done)
+    {
+      // Everything was published and picked up, the last sample must be the latest one
+      break;
+    }
+  }
+  producer.join();
+
+  EXPECT_EQ(torn, 0u);
+  EXPECT_EQ(out_of_order, 0u);
+  EXPECT_GT(updates, 0u);
+  EXPECT_EQ(last, samples);
+}